@@ -25,10 +25,161 @@ typedef unsigned long int __pilot_size_t;
 
 #endif // PILOT_DEFINE_SIZE_T
 
-/// GLOBAL VARS
-static void* arena = 0;
-static void* arena_cursor = 0;
-static size_t arena_length = 0;
+/// CONTEXT
+
+/**
+ * A memory pool shared by several contexts, usually one per thread.
+ * 
+ * Contexts carve large slabs out of the shared arena with a single atomic
+ * bump, then serve their own allocations out of their slab without any
+ * synchronization at all.
+ */
+typedef struct plt_shared_arena_s {
+    // Memory allocated for our use by the consumer.
+    void* arena;
+    // How many bytes have been handed out as slabs. Only touched atomically.
+    volatile size_t used_length;
+    // How many bytes the arena holds.
+    size_t arena_length;
+} plt_shared_arena;
+
+/**
+ * Asks the consumer for another block of memory, once a context's arena has
+ * run out.
+ * 
+ * @param   minimum_size    The least number of bytes the block must hold.
+ * @param   provided_size   Receives how many bytes the block actually holds,
+ *                          which may be (and usually should be) more.
+ * @param   user_data   Whatever the consumer passed to plt_set_block_provider().
+ * @return  The block, or null if there's no more memory to give.
+ */
+typedef void* (*plt_provide_block)(
+    size_t minimum_size,
+    size_t* provided_size,
+    void* user_data);
+
+/**
+ * Gives a block from a plt_provide_block back to the consumer.
+ * 
+ * @param   block   The block.
+ * @param   size    How many bytes the block holds.
+ * @param   user_data   Whatever the consumer passed to plt_set_block_provider().
+ */
+typedef void (*plt_release_block)(void* block, size_t size, void* user_data);
+
+/**
+ * The header at the start of every block a context gets from its provider.
+ */
+typedef struct plt_block_s {
+    // The block the context got before this one, if any.
+    struct plt_block_s* previous;
+    // How many bytes the block holds, header included.
+    size_t size;
+} plt_block;
+
+// How many size classes the pool allocator has. Class i holds objects of up to
+// (i + 1) * PLT_POOL_GRANULE bytes, so bigger objects skip the pools.
+#ifndef PILOT_POOL_CLASS_COUNT
+#define PILOT_POOL_CLASS_COUNT 16
+#endif
+
+// Roughly how many bytes a size class carves out of the arena at a time.
+#ifndef PILOT_POOL_BATCH_SIZE
+#define PILOT_POOL_BATCH_SIZE 512
+#endif
+
+// The size (and alignment) pool objects are rounded up to.
+#define PLT_POOL_GRANULE (2 * sizeof(size_t))
+
+/**
+ * Live statistics about a context's memory use, for sizing arenas and pools.
+ */
+typedef struct plt_arena_stats_s {
+    // How many bytes the context has handed out, padding and headers included.
+    size_t used_length;
+    // The most bytes the context has ever had handed out at once.
+    size_t peak_length;
+    // How many allocations the context has made.
+    size_t allocation_count;
+    // How many of the used bytes were left behind when reallocate() had to
+    // copy an allocation somewhere else.
+    size_t stranded_length;
+} plt_arena_stats;
+
+#ifdef PILOT_ENABLE_ALLOCATION_TRACE
+
+// How many of the latest allocations the trace remembers.
+#ifndef PILOT_ALLOCATION_TRACE_LENGTH
+#define PILOT_ALLOCATION_TRACE_LENGTH 256
+#endif
+
+/**
+ * One allocation in a context's allocation trace.
+ */
+typedef struct plt_allocation_record_s {
+    // How many bytes were asked for.
+    size_t size;
+    // The start of the arena (or slab, or block) the memory came out of.
+    const void* base;
+    // Where the memory starts, from base.
+    size_t offset;
+    // The source file and line the allocation was asked for from, or null
+    // and zero if it's not known.
+    const char* file;
+    int line;
+    // The context's allocation tag at the time. See plt_set_allocation_tag().
+    const char* tag;
+} plt_allocation_record;
+
+#endif // PILOT_ENABLE_ALLOCATION_TRACE
+
+/**
+ * Stores everything one instance of Pilot Scheme owns.
+ * 
+ * Nothing in Pilot Scheme is global, so every context is independent of every
+ * other one. Give each thread its own context and they never have to lock.
+ */
+typedef struct plt_context_s {
+    // Memory allocated for our use by the consumer.
+    void* arena;
+    // Where the next allocation in the arena starts.
+    void* arena_cursor;
+    // How many bytes the arena holds.
+    size_t arena_length;
+    // The shared arena the context takes its slabs from, if it has one. When
+    // it does, arena is just the context's current slab.
+    plt_shared_arena* shared;
+    // How many bytes to take from the shared arena at a time.
+    size_t slab_size;
+    // Where to get more memory once the arena runs out, if anywhere.
+    plt_provide_block provide_block;
+    // Where to give that memory back, if anywhere.
+    plt_release_block release_block;
+    // Passed along to the provider's callbacks.
+    void* provider_data;
+    // The most recent block from the provider. When there is one, arena is
+    // usually that block.
+    plt_block* blocks;
+    // The freed objects of each pool size class, each one pointing to the
+    // next.
+    void* pool_free_lists[PILOT_POOL_CLASS_COUNT];
+    // How many objects have ever been put on the free lists, so plt_rewind()
+    // can tell whether any of them might be in the memory it frees.
+    size_t pool_free_count;
+    // What the context's memory is up to. See plt_get_arena_stats().
+    plt_arena_stats stats;
+    #ifdef PILOT_ENABLE_ALLOCATION_TRACE
+    // Labels the allocations made from now on in the trace.
+    const char* allocation_tag;
+    // Where in the code the next allocation is asked for from.
+    const char* allocation_file;
+    int allocation_line;
+    // The latest allocations, oldest overwritten first.
+    plt_allocation_record allocation_trace[PILOT_ALLOCATION_TRACE_LENGTH];
+    // How many allocations have ever been recorded.
+    size_t allocation_trace_count;
+    #endif
+} plt_context;
 
 /// INITIALIZATION
 
@@ -39,433 +190,6595 @@ static size_t arena_length = 0;
  * compiler. Pilot Scheme needs a memory pool to allocate over so that we don't
  * have to depend on a custom allocator.
  * 
+ * @param   context The context to initialize.
  * @param   provided_arena  Memory allocated for our use by the consumer.
  * @param   max_size        There's no way in hell we're relying on sentinels.
  */
 void
-plt_init(void* provided_arena, const size_t max_size)
+plt_init(plt_context* context, void* provided_arena, const size_t max_size)
+{
+    context->arena = provided_arena;
+    context->arena_cursor = context->arena;
+    context->arena_length = max_size;
+    context->shared = 0;
+    context->slab_size = 0;
+    context->provide_block = 0;
+    context->release_block = 0;
+    context->provider_data = 0;
+    context->blocks = 0;
+
+    for (int i = 0; i < PILOT_POOL_CLASS_COUNT; i++)
+        context->pool_free_lists[i] = 0;
+
+    context->pool_free_count = 0;
+    context->stats.used_length = 0;
+    context->stats.peak_length = 0;
+    context->stats.allocation_count = 0;
+    context->stats.stranded_length = 0;
+
+    #ifdef PILOT_ENABLE_ALLOCATION_TRACE
+    context->allocation_tag = 0;
+    context->allocation_file = 0;
+    context->allocation_line = 0;
+    context->allocation_trace_count = 0;
+    #endif
+}
+
+/**
+ * Shared arena initialization.
+ * 
+ * Use this instead of plt_init() when several contexts (on several threads)
+ * have to allocate from the same memory pool. Each context is then set up
+ * with plt_init_from_shared().
+ * 
+ * @param   shared  The shared arena to initialize.
+ * @param   provided_arena  Memory allocated for our use by the consumer.
+ * @param   max_size    How many bytes the memory pool holds.
+ */
+void
+plt_init_shared(
+    plt_shared_arena* shared,
+    void* provided_arena,
+    const size_t max_size)
+{
+    shared->arena = provided_arena;
+    shared->used_length = 0;
+    shared->arena_length = max_size;
+}
+
+/**
+ * Initializes a context that allocates from a shared arena.
+ * 
+ * The context starts out without a slab and takes its first one on its first
+ * allocation. A context must only ever be used by one thread at a time.
+ * 
+ * @param   context The context to initialize.
+ * @param   shared  The shared arena to take slabs from.
+ * @param   slab_size   How many bytes to take at a time. Bigger slabs mean
+ *                      fewer atomic operations, but more memory left unused
+ *                      at the end of each context's last slab.
+ */
+void
+plt_init_from_shared(
+    plt_context* context,
+    plt_shared_arena* shared,
+    const size_t slab_size)
+{
+    context->arena = 0;
+    context->arena_cursor = 0;
+    context->arena_length = 0;
+    context->shared = shared;
+    context->slab_size = slab_size;
+    context->provide_block = 0;
+    context->release_block = 0;
+    context->provider_data = 0;
+    context->blocks = 0;
+
+    for (int i = 0; i < PILOT_POOL_CLASS_COUNT; i++)
+        context->pool_free_lists[i] = 0;
+
+    context->pool_free_count = 0;
+    context->stats.used_length = 0;
+    context->stats.peak_length = 0;
+    context->stats.allocation_count = 0;
+    context->stats.stranded_length = 0;
+
+    #ifdef PILOT_ENABLE_ALLOCATION_TRACE
+    context->allocation_tag = 0;
+    context->allocation_file = 0;
+    context->allocation_line = 0;
+    context->allocation_trace_count = 0;
+    #endif
+}
+
+/**
+ * Lets a context grow past the memory it was initialized with.
+ * 
+ * Once the context's arena (or shared arena) runs out, it asks the provider
+ * for another block and carries on allocating from that, chaining the blocks
+ * together. Blocks are handed back to the release callback, if there is one,
+ * when plt_rewind() rewinds past them. Rewind to a mark made before the first
+ * block to release them all.
+ * 
+ * @param   context The context to give a provider.
+ * @param   provide_block   Where to get more memory from.
+ * @param   release_block   Where to give it back to. May be null.
+ * @param   user_data   Passed along to both callbacks.
+ */
+void
+plt_set_block_provider(
+    plt_context* context,
+    plt_provide_block provide_block,
+    plt_release_block release_block,
+    void* user_data)
 {
-    arena = provided_arena;
-    arena_cursor = arena;
-    arena_length = max_size;
+    context->provide_block = provide_block;
+    context->release_block = release_block;
+    context->provider_data = user_data;
 }
 
 /// MEMORY MANAGEMENT
 
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+/**
+ * Atomically reads a value another thread may be changing.
+ * 
+ * @param   target  The value to read.
+ * @return  The value.
+ */
+static size_t
+load_atomically(volatile size_t* target)
+{
+    #if defined(_MSC_VER) && !defined(__clang__)
+    // MSVC makes aligned volatile reads atomic.
+    return *target;
+    #else
+    return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+    #endif
+}
+
+/**
+ * Atomically replaces a value, but only if nobody else changed it first.
+ * 
+ * @param   target  The value to replace.
+ * @param   expected    What we believe the value is.
+ * @param   desired What to replace it with.
+ * @return  One if the value was replaced, or zero if it had changed.
+ */
+static int
+compare_and_swap(
+    volatile size_t* target,
+    const size_t expected,
+    const size_t desired)
+{
+    #if defined(_MSC_VER) && !defined(__clang__)
+    #if defined(_WIN64)
+    return (size_t)_InterlockedCompareExchange64(
+        (volatile long long*)target,
+        (long long)desired,
+        (long long)expected) == expected;
+    #else
+    return (size_t)_InterlockedCompareExchange(
+        (volatile long*)target,
+        (long)desired,
+        (long)expected) == expected;
+    #endif
+    #else
+    size_t actual = expected;
+    return __atomic_compare_exchange_n(
+        target,
+        &actual,
+        desired,
+        0,
+        __ATOMIC_ACQ_REL,
+        __ATOMIC_RELAXED);
+    #endif
+}
+
+/**
+ * Takes a new slab from a context's shared arena. Whatever was left of the old
+ * slab is abandoned.
+ * 
+ * @param   context The context that needs a slab.
+ * @param   minimum_size    The allocation the slab has to be able to hold.
+ * @return  One if the context has a new slab, or zero if the shared arena is
+ *          out of memory.
+ */
+static int
+take_slab(plt_context* context, const size_t minimum_size)
+{
+    plt_shared_arena* shared = context->shared;
+
+    // Keep slabs a multiple of the header size, so that they stay aligned.
+    size_t slab_size =
+        context->slab_size > minimum_size ? context->slab_size : minimum_size;
+    slab_size = (slab_size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+
+    // Even if another thread beats us to it between the read and the swap,
+    // the swap fails and we just try again with the new value.
+    for (;;)
+    {
+        const size_t used_length = load_atomically(&shared->used_length);
+
+        if (shared->arena_length - used_length < slab_size)
+            return 0;
+
+        if (compare_and_swap(
+            &shared->used_length,
+            used_length,
+            used_length + slab_size))
+        {
+            context->arena = (void*)((size_t)shared->arena + used_length);
+            context->arena_cursor = context->arena;
+            context->arena_length = slab_size;
+
+            return 1;
+        }
+    }
+}
+
+/**
+ * Gets another block from a context's provider and makes it the context's
+ * arena. Whatever was left of the old arena is abandoned.
+ * 
+ * @param   context The context that needs a block.
+ * @param   minimum_size    The allocation the block has to be able to hold.
+ * @return  One if the context has a new block, or zero if the provider is out
+ *          of memory.
+ */
+static int
+take_block(plt_context* context, const size_t minimum_size)
+{
+    const size_t needed_size = sizeof(plt_block) + minimum_size;
+    size_t provided_size = 0;
+
+    plt_block* block = context->provide_block(
+        needed_size,
+        &provided_size,
+        context->provider_data);
+
+    if (!block)
+        return 0;
+
+    if (provided_size < needed_size)
+    {
+        if (context->release_block)
+            context->release_block(block, provided_size, context->provider_data);
+
+        return 0;
+    }
+
+    block->previous = context->blocks;
+    block->size = provided_size;
+
+    context->blocks = block;
+    context->arena = block;
+    context->arena_cursor = (void*)((size_t)block + sizeof(plt_block));
+    context->arena_length = provided_size;
+
+    return 1;
+}
+
+/**
+ * Counts bytes against a context's statistics.
+ * 
+ * @param   context The context that used the bytes.
+ * @param   used_length How many more bytes are in use. Wraps around to give
+ *                      bytes back.
+ */
+static void
+count_used_length(plt_context* context, const size_t used_length)
+{
+    context->stats.used_length += used_length;
+
+    if (context->stats.used_length > context->stats.peak_length)
+        context->stats.peak_length = context->stats.used_length;
+}
+
+/**
+ * Works out how much padding has to go in front of an allocation so that the
+ * memory after its header lands on the given alignment.
+ * 
+ * @param   cursor  Where the allocation would start.
+ * @param   header_size How many bytes of header go in front of the memory.
+ * @param   alignment   The alignment the memory needs. A power of two.
+ * @return  The number of bytes of padding.
+ */
+static size_t
+padding_for(const void* cursor, const size_t header_size, const size_t alignment)
+{
+    return (0 - ((size_t)cursor + header_size)) & (alignment - 1);
+}
+
 /**
  * Custom allocator.
  * 
  * A linear allocator with basic boundary detection so we don't muddy the
- * consumer's carpet doing our work.
+ * consumer's carpet doing our work. Contexts on a shared arena take a new slab
+ * when their current one runs out, and contexts with a block provider take a
+ * new block when there's nothing else left.
+ * 
+ * Allocations normally carry a header with their size, which reallocate()
+ * needs. The header sits right in front of the memory, after any padding.
+ * 
+ * @param   context The context whose arena we allocate from.
+ * @param   requested_size  How big do you want it?
+ * @param   alignment   The alignment the memory needs. A power of two.
+ * @param   header_size Either sizeof(size_t) for a block with a header, or
+ *                      zero for one without.
+ * @return  The start address of the freshly allocated memory.
+ */
+static void*
+allocate_block(
+    plt_context* context,
+    const size_t requested_size,
+    const size_t alignment,
+    const size_t header_size)
+{
+    const size_t used_length =
+        (size_t)context->arena_cursor - (size_t)context->arena;
+
+    size_t actual_allocation_size =
+        padding_for(context->arena_cursor, header_size, alignment)
+        + header_size
+        + requested_size;
+
+    if (context->arena_length - used_length < actual_allocation_size)
+    {
+        // We can't know the padding until we know where the new memory is,
+        // so ask for enough room for the worst case.
+        const size_t worst_case_size =
+            header_size + requested_size + alignment - 1;
+
+        if (!(context->shared && take_slab(context, worst_case_size))
+            && !(context->provide_block && take_block(context, worst_case_size)))
+        {
+            #ifdef PLT_OUT_OF_MEMORY
+            if (context->shared)
+                PLT_OUT_OF_MEMORY(
+                    context->shared->used_length + worst_case_size,
+                    context->shared->arena_length) ;
+            else
+                PLT_OUT_OF_MEMORY(
+                    used_length + actual_allocation_size,
+                    context->arena_length) ;
+            #endif
+
+            return 0;
+        }
+
+        actual_allocation_size =
+            padding_for(context->arena_cursor, header_size, alignment)
+            + header_size
+            + requested_size;
+    }
+
+    const size_t end =
+        (size_t)context->arena_cursor + actual_allocation_size;
+    const size_t allocated_pointer = end - requested_size;
+
+    if (header_size)
+        *(size_t*)(allocated_pointer - sizeof(size_t)) = requested_size;
+
+    context->arena_cursor = (void*)end;
+
+    context->stats.allocation_count++;
+    count_used_length(context, actual_allocation_size);
+
+    #ifdef PILOT_ENABLE_ALLOCATION_TRACE
+    plt_allocation_record* record = &context->allocation_trace[
+        context->allocation_trace_count++ % PILOT_ALLOCATION_TRACE_LENGTH];
+    record->size = requested_size;
+    record->base = context->arena;
+    record->offset = allocated_pointer - (size_t)context->arena;
+    record->file = context->allocation_file;
+    record->line = context->allocation_line;
+    record->tag = context->allocation_tag;
+
+    // Each site only accounts for its own allocation.
+    context->allocation_file = 0;
+    context->allocation_line = 0;
+    #endif
+
+    return (void*)allocated_pointer;
+}
+
+/**
+ * Allocates memory that can be reallocated, aligned for any size_t.
  * 
+ * @param   context The context whose arena we allocate from.
  * @param   requested_size  How big do you want it?
  * @return  The start address of the freshly allocated memory.
  */
 static void*
-allocate(const size_t requested_size)
+allocate(plt_context* context, const size_t requested_size)
+{
+    return allocate_block(
+        context,
+        requested_size,
+        sizeof(size_t),
+        sizeof(size_t));
+}
+
+/**
+ * Allocates memory on a given alignment, for things like SIMD lanes or data
+ * that should sit on a cache line of its own.
+ * 
+ * The memory has a size header like every other allocation, so it can still
+ * be grown with the stretchy buffer and reallocation machinery.
+ * 
+ * @param   context The context whose arena we allocate from.
+ * @param   requested_size  How big do you want it?
+ * @param   alignment   The alignment the memory needs. A power of two; anything
+ *                      under sizeof(size_t) is rounded up to it.
+ * @return  The start address of the freshly allocated memory (or null if out of
+ *          memory).
+ */
+void*
+plt_allocate_aligned(
+    plt_context* context,
+    const size_t requested_size,
+    const size_t alignment)
+{
+    return allocate_block(
+        context,
+        requested_size,
+        alignment > sizeof(size_t) ? alignment : sizeof(size_t),
+        sizeof(size_t));
+}
+
+/**
+ * Allocates memory on a given alignment, without a size header.
+ * 
+ * That saves a size_t per allocation, which adds up for small objects, but the
+ * memory must never be reallocated.
+ * 
+ * @param   context The context whose arena we allocate from.
+ * @param   requested_size  How big do you want it?
+ * @param   alignment   The alignment the memory needs. A power of two.
+ * @return  The start address of the freshly allocated memory (or null if out of
+ *          memory).
+ */
+void*
+plt_allocate_headerless(
+    plt_context* context,
+    const size_t requested_size,
+    const size_t alignment)
+{
+    return allocate_block(context, requested_size, alignment, 0);
+}
+
+/**
+ * Budget memcpy().
+ * 
+ * Copies data from source to destination. Literally memcpy(), which GCC and
+ * Clang get to inline and vectorize as they see fit. Everywhere else, we copy
+ * a word at a time once the destination is aligned, as long as the source
+ * lines up with it.
+ * 
+ * @param   source  Pointer to source data.
+ * @param   source_size Better safe than sorry.
+ * @param   destination Pointer to data destination.
+ */
+static void
+copy(const char* source, const size_t source_size, char* destination)
+{
+    #if defined(__GNUC__) || defined(__clang__)
+    __builtin_memcpy(destination, source, source_size);
+    #else
+    size_t i = 0;
+
+    if ((((size_t)source ^ (size_t)destination) & (sizeof(size_t) - 1)) == 0)
+    {
+        const size_t misalignment = (size_t)destination & (sizeof(size_t) - 1);
+        const size_t head_size =
+            misalignment ? sizeof(size_t) - misalignment : 0;
+
+        for (; i < source_size && i < head_size; i++)
+            destination[i] = source[i];
+
+        for (; i + sizeof(size_t) <= source_size; i += sizeof(size_t))
+            *(size_t*)(destination + i) = *(const size_t*)(source + i);
+    }
+
+    for (; i < source_size; i++)
+        destination[i] = source[i];
+    #endif
+}
+
+/**
+ * Resizes an allocation without moving it, which is only possible when it is
+ * the last allocation in the arena and the arena has room for the new size.
+ * 
+ * @param   context The context whose arena we allocate from.
+ * @param   pointer The allocation to resize.
+ * @param   new_size    The number of bytes the allocation should hold.
+ * @return  One if the allocation was resized, otherwise zero.
+ */
+static int
+resize_in_place(plt_context* context, const void* pointer, const size_t new_size)
+{
+    size_t* size = (size_t*)((size_t)pointer - sizeof(size_t));
+
+    if ((size_t)pointer + *size != (size_t)context->arena_cursor)
+        return 0;
+
+    const size_t available_size =
+        (size_t)context->arena + context->arena_length - (size_t)pointer;
+
+    if (available_size < new_size)
+        return 0;
+
+    count_used_length(context, new_size - *size);
+
+    *size = new_size;
+    context->arena_cursor = (void*)((size_t)pointer + new_size);
+
+    return 1;
+}
+
+/**
+ * Reallocates the given (allocated) pointer.
+ * 
+ * If the pointer is the last allocation in the arena, it simply grows (or
+ * shrinks) in place. Otherwise, it moves to a new region of the memory pool
+ * where it is allocated the requested new_size of bytes. All data from the old
+ * region is copied over, if the pointer is not null. The old pointer isn't
+ * cleaned up because we're using a simple linear allocator that doesn't care
+ * about reclaiming space.
+ * 
+ * @param   context The context whose arena we allocate from.
+ * @param   pointer The pointer to reallocate.
+ * @param   new_size    The number of bytes to allocate to the pointer.
+ * @return  A pointer to the newly allocated memory (or null if out of memory).
+ */
+static void*
+reallocate(plt_context* context, const void* pointer, const size_t new_size)
+{
+    if (pointer && resize_in_place(context, pointer, new_size))
+        return (void*)pointer;
+
+    void* new_pointer = allocate(context, new_size);
+
+    const size_t* old_size = (size_t*)((size_t)pointer - sizeof(size_t));
+
+    if (pointer && new_pointer)
+    {
+        copy(pointer, *old_size, new_pointer);
+        context->stats.stranded_length += *old_size + sizeof(size_t);
+    }
+
+    return new_pointer;
+}
+
+/// CHECKPOINTS
+
+/**
+ * A point in a context's arena that the context can be rewound to.
+ */
+typedef struct plt_arena_mark_s {
+    // The arena (or, for contexts on a shared arena, the slab) the mark is in.
+    void* arena;
+    // Where the next allocation started when the mark was made.
+    void* arena_cursor;
+    // How many bytes the arena (or slab) holds.
+    size_t arena_length;
+    // The most recent block from the context's provider.
+    plt_block* blocks;
+    // How many bytes the context had handed out.
+    size_t used_length;
+    // How many of those were stranded by reallocate().
+    size_t stranded_length;
+    // How many objects had been put on the pools' free lists.
+    size_t pool_free_count;
+} plt_arena_mark;
+
+/**
+ * Marks the current end of a context's arena.
+ * 
+ * @param   context The context to mark.
+ * @return  A mark that plt_rewind() can take the context back to.
+ */
+plt_arena_mark
+plt_mark(const plt_context* context)
+{
+    plt_arena_mark mark;
+    mark.arena = context->arena;
+    mark.arena_cursor = context->arena_cursor;
+    mark.arena_length = context->arena_length;
+    mark.blocks = context->blocks;
+    mark.used_length = context->stats.used_length;
+    mark.stranded_length = context->stats.stranded_length;
+    mark.pool_free_count = context->pool_free_count;
+
+    return mark;
+}
+
+/**
+ * Frees everything allocated from a context since a mark was made, in one go.
+ * 
+ * Anything allocated after the mark must not be used again, and that includes
+ * stretchy buffers that grew after the mark, such as a lexer's buffer. Marks
+ * have to be rewound in the reverse order they were made in.
+ * 
+ * A context on a shared arena gives its current slab back when the mark is in
+ * an older slab and no other context has taken a slab since. Otherwise, the
+ * slabs taken after the mark are left unused.
+ * 
+ * Blocks the context got from its provider after the mark are released.
+ * 
+ * Objects put on the pools' free lists since the mark are dropped from them
+ * if they're in the memory being rewound, and the rest stay. When the rewind
+ * goes back past other blocks or slabs, the free lists are emptied instead, so
+ * objects freed since the mark are simply not reused.
+ * 
+ * @param   context The context to rewind.
+ * @param   mark    A mark made by plt_mark() on the same context.
+ */
+void
+plt_rewind(plt_context* context, const plt_arena_mark mark)
 {
-    const size_t used_length = (size_t)arena_cursor - (size_t)arena;
+    // Whether the memory being rewound is just the end of the current arena.
+    const int is_within_arena =
+        context->arena == mark.arena && context->blocks == mark.blocks;
+    const char* rewound_end = context->arena_cursor;
+
+    while (context->blocks != mark.blocks)
+    {
+        plt_block* block = context->blocks;
+        context->blocks = block->previous;
+
+        // Don't give our slab back below if we're not even in it anymore.
+        if (context->arena == block)
+            context->arena = 0;
+
+        if (context->release_block)
+            context->release_block(block, block->size, context->provider_data);
+    }
+
+    if (context->shared && context->arena != mark.arena && context->arena)
+    {
+        const size_t slab_start =
+            (size_t)context->arena - (size_t)context->shared->arena;
+
+        compare_and_swap(
+            &context->shared->used_length,
+            slab_start + context->arena_length,
+            slab_start);
+    }
+
+    context->arena = mark.arena;
+    context->arena_cursor = mark.arena_cursor;
+    context->arena_length = mark.arena_length;
+
+    // Objects already on the free lists at the mark were allocated before it.
+    if (context->pool_free_count != mark.pool_free_count)
+        for (int i = 0; i < PILOT_POOL_CLASS_COUNT; i++)
+        {
+            void** link = &context->pool_free_lists[i];
+
+            if (!is_within_arena)
+                *link = 0;
+
+            while (*link)
+                if ((char*)*link >= (char*)mark.arena_cursor
+                    && (char*)*link < rewound_end)
+                    *link = *(void**)*link;
+                else
+                    link = (void**)*link;
+        }
+
+    context->stats.used_length = mark.used_length;
+    context->stats.stranded_length = mark.stranded_length;
+}
+
+/**
+ * A scope of temporary memory: everything allocated from the context between
+ * plt_begin_temporary_memory() and plt_end_temporary_memory() is freed by the
+ * latter.
+ */
+typedef struct plt_temporary_memory_s {
+    // The context the temporary memory comes from.
+    plt_context* context;
+    // Where the context's arena ended when the scope began.
+    plt_arena_mark mark;
+} plt_temporary_memory;
+
+/**
+ * Begins a scope of temporary memory, for a pass (lexing, parsing, evaluation)
+ * that doesn't need to keep anything it allocates.
+ * 
+ * Scopes can be nested, as long as they end in the reverse order they began.
+ * 
+ * @param   context The context to take the temporary memory from.
+ * @return  The scope, to hand to plt_end_temporary_memory().
+ */
+plt_temporary_memory
+plt_begin_temporary_memory(plt_context* context)
+{
+    plt_temporary_memory temporary;
+    temporary.context = context;
+    temporary.mark = plt_mark(context);
+
+    return temporary;
+}
+
+/**
+ * Ends a scope of temporary memory, freeing everything allocated in it.
+ * 
+ * @param   temporary   The scope returned by plt_begin_temporary_memory().
+ */
+void
+plt_end_temporary_memory(const plt_temporary_memory temporary)
+{
+    plt_rewind(temporary.context, temporary.mark);
+}
+
+/// POOLS
+
+/**
+ * Allocates a small fixed-size object, such as a cons cell or a closure, from
+ * its size class's pool.
+ * 
+ * Freed objects are reused first. When there are none, the class carves a
+ * batch of neighbouring objects out of the arena at once, so objects
+ * allocated together sit together. Objects are aligned to PLT_POOL_GRANULE.
+ * 
+ * Objects too big for any size class are allocated straight from the arena,
+ * and are never reused.
+ * 
+ * @param   context The context whose arena the pools live in.
+ * @param   requested_size  How big do you want it?
+ * @return  The object (or null if out of memory).
+ */
+void*
+plt_pool_allocate(plt_context* context, const size_t requested_size)
+{
+    const size_t size_class =
+        requested_size ? (requested_size - 1) / PLT_POOL_GRANULE : 0;
+
+    if (size_class >= PILOT_POOL_CLASS_COUNT)
+        return plt_allocate_headerless(
+            context,
+            requested_size,
+            PLT_POOL_GRANULE);
+
+    void** free_list = &context->pool_free_lists[size_class];
+
+    if (*free_list)
+    {
+        void* object = *free_list;
+        *free_list = *(void**)object;
+
+        return object;
+    }
+
+    const size_t object_size = (size_class + 1) * PLT_POOL_GRANULE;
+    size_t object_count = PILOT_POOL_BATCH_SIZE / object_size;
+
+    // Don't give up a whole slab (or block) for a batch when whatever's left
+    // of the arena can still hold part of one.
+    const size_t used_length =
+        (size_t)context->arena_cursor
+        - (size_t)context->arena
+        + padding_for(context->arena_cursor, 0, PLT_POOL_GRANULE);
+
+    if (used_length < context->arena_length)
+    {
+        const size_t fitting_count =
+            (context->arena_length - used_length) / object_size;
+
+        if (fitting_count && fitting_count < object_count)
+            object_count = fitting_count;
+    }
+
+    if (!object_count)
+        object_count = 1;
+
+    char* batch = plt_allocate_headerless(
+        context,
+        object_count * object_size,
+        PLT_POOL_GRANULE);
+
+    if (!batch)
+        return 0;
+
+    // Keep the rest of the batch in address order, so that they're handed
+    // out front to back.
+    for (size_t i = object_count - 1; i > 0; i--)
+    {
+        void* object = batch + i * object_size;
+        *(void**)object = *free_list;
+        *free_list = object;
+    }
+
+    context->pool_free_count += object_count - 1;
+
+    return batch;
+}
+
+/**
+ * Gives an object from plt_pool_allocate() back to its pool, where the next
+ * allocation of its size class picks it up.
+ * 
+ * @param   context The context the object was allocated from.
+ * @param   object  The object. May be null.
+ * @param   size    The size the object was allocated with.
+ */
+void
+plt_pool_free(plt_context* context, void* object, const size_t size)
+{
+    const size_t size_class = size ? (size - 1) / PLT_POOL_GRANULE : 0;
+
+    if (!object || size_class >= PILOT_POOL_CLASS_COUNT)
+        return;
+
+    void** free_list = &context->pool_free_lists[size_class];
+    *(void**)object = *free_list;
+    *free_list = object;
+    context->pool_free_count++;
+}
+
+/// INSTRUMENTATION
+
+/**
+ * Reads a context's memory statistics.
+ * 
+ * Rewinding gives back used and stranded bytes, but the peak and the number of
+ * allocations only ever go up.
+ * 
+ * @param   context The context to read.
+ * @return  A copy of the context's statistics.
+ */
+plt_arena_stats
+plt_get_arena_stats(const plt_context* context)
+{
+    return context->stats;
+}
+
+#ifdef PILOT_ENABLE_ALLOCATION_TRACE
+
+/**
+ * Notes where in the code a context's next allocation is asked for from, so
+ * that its trace can tell which call sites allocate the most.
+ * 
+ * The allocation functions and macros do this for you, through
+ * __allocation_site(), with the file and line they're called from.
+ * 
+ * @param   context The context about to allocate.
+ * @param   file    The source file of the call.
+ * @param   line    The line of the call.
+ * @return  The context, so that the call can take it as its argument.
+ */
+static plt_context*
+at_allocation_site(plt_context* context, const char* file, const int line)
+{
+    context->allocation_file = file;
+    context->allocation_line = line;
+
+    return context;
+}
+
+#define __allocation_site(c) at_allocation_site((c), __FILE__, __LINE__)
+
+/**
+ * Labels the allocations a context makes from now on in its trace, so that
+ * they can be told apart by the pass that made them.
+ * 
+ * @param   context The context to label.
+ * @param   tag The label. Must outlive the trace, so a string literal is best.
+ * @return  The previous label, so that it can be put back afterwards.
+ */
+const char*
+plt_set_allocation_tag(plt_context* context, const char* tag)
+{
+    const char* previous_tag = context->allocation_tag;
+    context->allocation_tag = tag;
+
+    return previous_tag;
+}
+
+/**
+ * Copies a context's latest allocations out of its trace, oldest first.
+ * 
+ * @param   context The context to read.
+ * @param   records Receives the allocations.
+ * @param   max_count   How many allocations records has room for.
+ * @return  How many allocations were copied.
+ */
+size_t
+plt_read_allocation_trace(
+    const plt_context* context,
+    plt_allocation_record* records,
+    const size_t max_count)
+{
+    size_t count = context->allocation_trace_count;
+
+    if (count > PILOT_ALLOCATION_TRACE_LENGTH)
+        count = PILOT_ALLOCATION_TRACE_LENGTH;
+
+    if (count > max_count)
+        count = max_count;
+
+    // Skip the oldest records that don't fit.
+    const size_t first = context->allocation_trace_count - count;
+
+    for (size_t i = 0; i < count; i++)
+        records[i] = context->allocation_trace[
+            (first + i) % PILOT_ALLOCATION_TRACE_LENGTH];
+
+    return count;
+}
+
+#else
+
+#define __allocation_site(c) (c)
+
+#endif // PILOT_ENABLE_ALLOCATION_TRACE
+
+/// DYNAMIC BUFFERS
+
+/**
+ * Appends a value to the end of a stretchy buffer. After appending, tags a null
+ * terminator to the end of the stretchy buffer.
+ * 
+ * NOTE: The null terminator trick may not work for struct types!
+ * 
+ * If the buffer can't grow, nothing is appended and the buffer is left as it
+ * was.
+ * 
+ * @param c The context whose arena the stretchy buffer grows in.
+ * @param b Either a NULL pointer or pointer to a stretchy buffer.
+ * @param value The value to append to the stretchy buffer.
+ * @return  One if the value was appended, or zero if out of memory.
+ */
+#define buffer_append(c, b, value) \
+    ((__buffer_maybe_grow(c, b, 1), __buffer_has_room(b, 1)) \
+    ? ((b)[__buffer_used(b)++] = (value), \
+        (b)[__buffer_used(b)] = 0, \
+        1) \
+    : 0)
+
+/**
+ * Adds room for n items to the end of a stretchy buffer in one go, and tags a
+ * null terminator after them. The new items are left for the caller to fill
+ * in, usually with copy().
+ * 
+ * If the buffer can't grow, nothing is added and the buffer is left as it was.
+ * 
+ * @param c The context whose arena the stretchy buffer grows in.
+ * @param b Either a NULL pointer or pointer to a stretchy buffer.
+ * @param n The number of items to add. Evaluated more than once.
+ * @return  A pointer to the first new item, or null if out of memory.
+ */
+#define buffer_add_n(c, b, n) \
+    ((__buffer_maybe_grow(c, b, (n)), __buffer_has_room(b, (n))) \
+    ? (__buffer_used(b) += (n), \
+        (b)[__buffer_used(b)] = 0, \
+        &(b)[__buffer_used(b) - (n)]) \
+    : 0)
+
+/**
+ * Returns the number of items currently in the stretchy buffer.
+ * 
+ * @param b Either a NULL pointer or a pointer to a stretchy buffer.
+ * @return  The number of items in the stretchy buffer. (Zero for NULL pointer.)
+ */
+#define buffer_count(b) ((b) ? __buffer_used(b) : 0)
+
+/**
+ * Sets the "used" section of the stretchy buffer header to 0, effectively 
+ * resetting the buffer.
+ * 
+ * @param b Either a NULL pointer or a pointer to a stretchy buffer.
+ * @return  Zero.
+ */
+#define buffer_reset(b) ((b) ? __buffer_used(b) = 0 : 0)
+
+/**
+ * Retrieves the raw stretchy buffer as a size_t*. This allows direct access to
+ * the 'size' and 'used' values, stored at index 0 and index 1, respectively.
+ * 
+ * @param b A pointer to a stretchy buffer.
+ * @return  The pointer to the raw stretchy buffer.
+ */
+#define __buffer_raw(b) \
+    ((size_t*)((size_t)(b) - (sizeof(size_t) * 2)))
+
+/**
+ * Retrieves the 'size' value from a stretchy buffer.
+ * 
+ * @param b A pointer to a stretchy buffer.
+ * @return  The amount of space allocated to the stretchy buffer.
+ */
+#define __buffer_size(b) __buffer_raw(b)[0]
+
+/**
+ * Retrieves the 'used' value from a stretchy buffer.
+ * 
+ * @param b A pointer to a stretchy buffer.
+ * @return  The number of items in the stretchy buffer.
+ */
+#define __buffer_used(b) __buffer_raw(b)[1]
+
+/**
+ * Decides if a stretchy buffer needs to grow to accomodate more elements.
+ * 
+ * @param b Either a NULL pointer or a pointer to a stretchy buffer.
+ * @param increment The number of new elements the buffer needs to accomodate.
+ * @return  Zero if buffer has space, or one if buffer needs to be reallocated.
+ */
+#define __buffer_needs_to_grow(b, increment) \
+    ((b) == 0 || __buffer_used(b) + (increment) >= __buffer_size(b))
+
+/**
+ * Decides if a stretchy buffer has room for more elements, which is only false
+ * after it failed to grow.
+ * 
+ * @param b Either a NULL pointer or a pointer to a stretchy buffer.
+ * @param increment The number of new elements the buffer needs to accomodate.
+ * @return  One if the buffer has room, otherwise zero.
+ */
+#define __buffer_has_room(b, increment) \
+    ((b) != 0 && !__buffer_needs_to_grow(b, (increment)))
+
+/**
+ * Grows the stretch buffer by calling __buffer_growf() and then assigning the
+ * passed buffer to the newly allocated pointer.
+ * 
+ * @param c The context whose arena the stretchy buffer grows in.
+ * @param b Either a NULL pointer or a pointer to a stretchy buffer.
+ * @param increment The number of new elements the buffer needs to accomodate.
+ * @return  A pointer to the reallocated buffer.
+ */ 
+#define __buffer_grow(c, b, increment) \
+    (*((void**)&(b)) = __buffer_growf( \
+        __allocation_site(c), \
+        (b), \
+        (increment), \
+        sizeof(*(b))))
+
+/**
+ * Optionally grows the stretchy buffer if the buffer needs to grow.
+ * 
+ * @param c The context whose arena the stretchy buffer grows in.
+ * @param b Either a null pointer or a pointer to a stretchy buffer.
+ * @param increment The number of new elements the buffer needs to accomodate.
+ * @return  Zero or the pointer to the reallocated buffer.
+ */
+#define __buffer_maybe_grow(c, b, increment) \
+    ((__buffer_needs_to_grow(b, (increment))) \
+    ? __buffer_grow(c, b, (increment)) \
+    : 0)
+
+/**
+ * Grows a stretchy buffer.
+ * 
+ * @param context   The context whose arena the stretchy buffer grows in.
+ * @param buffer    Either a NULL pointer or a pointer to a stretchy buffer.
+ * @param increment The number of new elements the buffer needs to accomodate.
+ * @param item_size The number of bytes an item in the stretchy buffer takes up.
+ * @return  A pointer to the newly (re)allocated stretchy buffer (or the
+ *          original buffer, unchanged, if out of memory).
+ */
+static void*
+__buffer_growf(
+    plt_context* context,
+    void* buffer,
+    const size_t increment,
+    size_t item_size)
+{
+    size_t double_current_size = buffer ? 2 * (__buffer_size(buffer)) : 0;
+    // Leave a spare slot past the new items for buffer_append()'s null
+    // terminator, which __buffer_needs_to_grow() always keeps free.
+    size_t minimum_needed_size = buffer_count(buffer) + increment + 1;
+
+    // We do this because, when the buffer is empty (i.e. NULL pointer),
+    // double_current_size is zero and minimum_needed_size is two. This also
+    // allows us to implement a stb_sb_add() macro that grows the buffer by an
+    // arbitrary increment, instead of an increment of one.
+    size_t new_size =
+        double_current_size > minimum_needed_size
+        ? double_current_size
+        : minimum_needed_size;
+
+    // A buffer at the end of the arena grows without being copied or leaving
+    // its old copy behind. If doubling it doesn't fit, the space it actually
+    // needs still might.
+    if (buffer)
+    {
+        if (resize_in_place(
+            context,
+            __buffer_raw(buffer),
+            item_size * new_size + sizeof(size_t) * 2))
+        {
+            __buffer_size(buffer) = new_size;
+            return buffer;
+        }
+
+        if (resize_in_place(
+            context,
+            __buffer_raw(buffer),
+            item_size * minimum_needed_size + sizeof(size_t) * 2))
+        {
+            __buffer_size(buffer) = minimum_needed_size;
+            return buffer;
+        }
+    }
+
+    size_t* new_buffer = reallocate(
+        context,
+        buffer ? __buffer_raw(buffer) : 0,
+        item_size * new_size + sizeof(size_t) * 2);
+
+    if (new_buffer)
+    {
+        new_buffer[0] = new_size;
+
+        if (!buffer)
+            new_buffer[1] = 0;
+
+        return &new_buffer[2];
+    }
+    // Out of memory.
+    else return buffer;
+}
+
+#ifdef PILOT_ENABLE_ALLOCATION_TRACE
+
+// From here on, allocations note the file and line they're asked for from,
+// including the consumer's own calls. The allocators above call each other
+// directly, so an allocation is put down to whoever asked for it rather than
+// to the allocator's insides.
+#define allocate(c, s) allocate(__allocation_site(c), (s))
+#define reallocate(c, p, s) reallocate(__allocation_site(c), (p), (s))
+#define plt_allocate_aligned(c, s, a) \
+    plt_allocate_aligned(__allocation_site(c), (s), (a))
+#define plt_allocate_headerless(c, s, a) \
+    plt_allocate_headerless(__allocation_site(c), (s), (a))
+#define plt_pool_allocate(c, s) plt_pool_allocate(__allocation_site(c), (s))
+
+#endif // PILOT_ENABLE_ALLOCATION_TRACE
+
+/// SCANNING
+
+// Pick the widest vector instructions the compiler lets us use. Consumers can
+// define PILOT_NO_SIMD to force the portable scalar scanners.
+#ifndef PILOT_NO_SIMD
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PILOT_SIMD_AVX2
+#define PILOT_SIMD_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PILOT_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PILOT_SIMD_NEON
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__) \
+    && (defined(PILOT_SIMD_SSE2) || defined(PILOT_SIMD_NEON))
+#include <intrin.h>
+#endif
+
+#endif // PILOT_NO_SIMD
+
+#define is_whitespace(c) \
+    ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+
+#define is_digit(c) ((c) >= '0' && (c) <= '9')
+
+#define is_alphanum(c) \
+    (is_digit(c) \
+    || ((c) >= 'A' && (c) <= 'Z') \
+    || ((c) >= 'a' && (c) <= 'z') \
+    || ((c) == '_') \
+    || ((c) == '-'))
+
+#if defined(PILOT_SIMD_SSE2) || defined(PILOT_SIMD_NEON)
+
+/**
+ * Finds the index of the lowest set bit in a non-zero mask.
+ * 
+ * @param   mask    The mask to search. Must not be zero.
+ * @return  The number of zero bits below the lowest set bit.
+ */
+static unsigned int
+count_trailing_zeros(const unsigned long long mask)
+{
+    #if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (unsigned int)index;
+    #else
+    return (unsigned int)__builtin_ctzll(mask);
+    #endif
+}
+
+#endif
+
+#if defined(PILOT_SIMD_SSE2)
+
+/**
+ * Builds a 16 byte mask of which bytes fall in the inclusive range [lo, hi].
+ * 
+ * Comparisons are signed, so this only works for ASCII ranges. Conveniently,
+ * that also means UTF8 bytes (which are all negative) never match.
+ */
+#define sse2_in_range(v, lo, hi) \
+    _mm_and_si128( \
+        _mm_cmpgt_epi8((v), _mm_set1_epi8((char)((lo) - 1))), \
+        _mm_cmplt_epi8((v), _mm_set1_epi8((char)((hi) + 1))))
+
+#define sse2_whitespace_mask(v) \
+    _mm_or_si128( \
+        _mm_or_si128( \
+            _mm_cmpeq_epi8((v), _mm_set1_epi8(' ')), \
+            _mm_cmpeq_epi8((v), _mm_set1_epi8('\t'))), \
+        _mm_or_si128( \
+            _mm_cmpeq_epi8((v), _mm_set1_epi8('\r')), \
+            _mm_cmpeq_epi8((v), _mm_set1_epi8('\n'))))
+
+#define sse2_digit_mask(v) sse2_in_range(v, '0', '9')
+
+// Setting bit 5 folds upper case letters onto lower case ones without folding
+// anything else into the 'a' to 'z' range.
+#define sse2_alphanum_mask(v) \
+    _mm_or_si128( \
+        _mm_or_si128( \
+            sse2_digit_mask(v), \
+            sse2_in_range(_mm_or_si128((v), _mm_set1_epi8(0x20)), 'a', 'z')), \
+        _mm_or_si128( \
+            _mm_cmpeq_epi8((v), _mm_set1_epi8('_')), \
+            _mm_cmpeq_epi8((v), _mm_set1_epi8('-'))))
+
+#endif
+
+#if defined(PILOT_SIMD_AVX2)
+
+#define avx2_in_range(v, lo, hi) \
+    _mm256_and_si256( \
+        _mm256_cmpgt_epi8((v), _mm256_set1_epi8((char)((lo) - 1))), \
+        _mm256_cmpgt_epi8(_mm256_set1_epi8((char)((hi) + 1)), (v)))
+
+#define avx2_whitespace_mask(v) \
+    _mm256_or_si256( \
+        _mm256_or_si256( \
+            _mm256_cmpeq_epi8((v), _mm256_set1_epi8(' ')), \
+            _mm256_cmpeq_epi8((v), _mm256_set1_epi8('\t'))), \
+        _mm256_or_si256( \
+            _mm256_cmpeq_epi8((v), _mm256_set1_epi8('\r')), \
+            _mm256_cmpeq_epi8((v), _mm256_set1_epi8('\n'))))
+
+#define avx2_digit_mask(v) avx2_in_range(v, '0', '9')
+
+#define avx2_alphanum_mask(v) \
+    _mm256_or_si256( \
+        _mm256_or_si256( \
+            avx2_digit_mask(v), \
+            avx2_in_range( \
+                _mm256_or_si256((v), _mm256_set1_epi8(0x20)), 'a', 'z')), \
+        _mm256_or_si256( \
+            _mm256_cmpeq_epi8((v), _mm256_set1_epi8('_')), \
+            _mm256_cmpeq_epi8((v), _mm256_set1_epi8('-'))))
+
+#endif
+
+#if defined(PILOT_SIMD_NEON)
+
+#define neon_in_range(v, lo, hi) \
+    vandq_u8(vcgeq_u8((v), vdupq_n_u8(lo)), vcleq_u8((v), vdupq_n_u8(hi)))
+
+#define neon_whitespace_mask(v) \
+    vorrq_u8( \
+        vorrq_u8(vceqq_u8((v), vdupq_n_u8(' ')), vceqq_u8((v), vdupq_n_u8('\t'))), \
+        vorrq_u8(vceqq_u8((v), vdupq_n_u8('\r')), vceqq_u8((v), vdupq_n_u8('\n'))))
+
+#define neon_digit_mask(v) neon_in_range(v, '0', '9')
+
+#define neon_alphanum_mask(v) \
+    vorrq_u8( \
+        vorrq_u8( \
+            neon_digit_mask(v), \
+            neon_in_range(vorrq_u8((v), vdupq_n_u8(0x20)), 'a', 'z')), \
+        vorrq_u8(vceqq_u8((v), vdupq_n_u8('_')), vceqq_u8((v), vdupq_n_u8('-'))))
+
+/**
+ * Squeezes a 16 byte NEON comparison mask into a 64-bit integer, with four
+ * bits per byte, since NEON has no movemask instruction.
+ */
+#define neon_movemask(m) \
+    vget_lane_u64( \
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0)
+
+#endif
+
+/**
+ * Defines a scanner that skips over a run of bytes belonging to one character
+ * class, as many bytes at a time as the target allows. Each scanner takes the
+ * source, the offset to start at and the length of the source, and returns the
+ * offset of the first byte at or after the start that isn't in the class (or
+ * the source length if the run goes all the way to the end).
+ * 
+ * @param name  The name of the scanner function.
+ * @param class The name of the character class, as used by the mask macros.
+ * @param is_in_class   The scalar test for the character class.
+ */
+#if defined(PILOT_SIMD_AVX2)
+
+#define __define_scanner(name, class, is_in_class) \
+    static size_t \
+    name( \
+        const char* source, \
+        size_t offset, \
+        const size_t source_length) \
+    { \
+        while (offset + 32 <= source_length) \
+        { \
+            const __m256i v = \
+                _mm256_loadu_si256((const __m256i*)(source + offset)); \
+            const unsigned int outside = \
+                ~(unsigned int)_mm256_movemask_epi8(avx2_ ## class ## _mask(v)); \
+            if (outside) \
+                return offset + count_trailing_zeros(outside); \
+            offset += 32; \
+        } \
+        while (offset + 16 <= source_length) \
+        { \
+            const __m128i v = \
+                _mm_loadu_si128((const __m128i*)(source + offset)); \
+            const unsigned int outside = \
+                ~_mm_movemask_epi8(sse2_ ## class ## _mask(v)) & 0xFFFF; \
+            if (outside) \
+                return offset + count_trailing_zeros(outside); \
+            offset += 16; \
+        } \
+        while (offset < source_length && is_in_class(source[offset])) \
+            offset++; \
+        return offset; \
+    }
+
+#elif defined(PILOT_SIMD_SSE2)
+
+#define __define_scanner(name, class, is_in_class) \
+    static size_t \
+    name( \
+        const char* source, \
+        size_t offset, \
+        const size_t source_length) \
+    { \
+        while (offset + 16 <= source_length) \
+        { \
+            const __m128i v = \
+                _mm_loadu_si128((const __m128i*)(source + offset)); \
+            const unsigned int outside = \
+                ~_mm_movemask_epi8(sse2_ ## class ## _mask(v)) & 0xFFFF; \
+            if (outside) \
+                return offset + count_trailing_zeros(outside); \
+            offset += 16; \
+        } \
+        while (offset < source_length && is_in_class(source[offset])) \
+            offset++; \
+        return offset; \
+    }
+
+#elif defined(PILOT_SIMD_NEON)
+
+#define __define_scanner(name, class, is_in_class) \
+    static size_t \
+    name( \
+        const char* source, \
+        size_t offset, \
+        const size_t source_length) \
+    { \
+        while (offset + 16 <= source_length) \
+        { \
+            const uint8x16_t v = vld1q_u8((const uint8_t*)(source + offset)); \
+            const unsigned long long outside = \
+                ~neon_movemask(neon_ ## class ## _mask(v)); \
+            if (outside) \
+                return offset + count_trailing_zeros(outside) / 4; \
+            offset += 16; \
+        } \
+        while (offset < source_length && is_in_class(source[offset])) \
+            offset++; \
+        return offset; \
+    }
+
+#else
+
+#define __define_scanner(name, class, is_in_class) \
+    static size_t \
+    name( \
+        const char* source, \
+        size_t offset, \
+        const size_t source_length) \
+    { \
+        while (offset < source_length && is_in_class(source[offset])) \
+            offset++; \
+        return offset; \
+    }
+
+#endif
+
+__define_scanner(scan_whitespace, whitespace, is_whitespace)
+__define_scanner(scan_digits, digit, is_digit)
+__define_scanner(scan_alphanum, alphanum, is_alphanum)
+
+#undef __define_scanner
+
+/// SYMBOLS
+
+// The symbol ID of tokens that aren't interned.
+#define PLT_NO_SYMBOL ((size_t)-1)
+
+/**
+ * Interns identifiers, so that every spelling of a name is stored once and
+ * identified by a small integer. Comparing names is then comparing IDs.
+ * 
+ * Symbol IDs count up from zero in the order names were first interned, and
+ * index straight into names, lengths and hashes. The table itself is an open
+ * addressing hash table over those IDs. Zero initialize it before use.
+ */
+typedef struct plt_symbol_table_s {
+    // The name of each symbol, null terminated.
+    const char** names;
+    // How many bytes each name is, not counting the terminator.
+    size_t* lengths;
+    // Each name's hash, so the table can grow without hashing names again.
+    size_t* hashes;
+    // How many symbols have been interned.
+    size_t count;
+    // How many symbols the arrays have room for.
+    size_t capacity;
+    // The hash table. Each slot holds a symbol ID plus one, or zero if empty.
+    size_t* slots;
+    // How many slots there are. Always zero or a power of two.
+    size_t slot_count;
+} plt_symbol_table;
+
+/**
+ * Hashes a name a word at a time, rather than a byte at a time.
+ * 
+ * @param   name    The name to hash.
+ * @param   length  How many bytes the name is.
+ * @return  The hash.
+ */
+static size_t
+hash_symbol(const char* name, const size_t length)
+{
+    const size_t multiplier = (size_t)0x9E3779B97F4A7C15ull;
+    size_t hash = length * multiplier;
+    size_t i = 0;
+
+    for (; i + sizeof(size_t) <= length; i += sizeof(size_t))
+    {
+        size_t word;
+        copy(name + i, sizeof(size_t), (char*)&word);
+
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+
+    // Fold whatever's left into one last word.
+    if (i < length)
+    {
+        size_t word = 0;
+        copy(name + i, length - i, (char*)&word);
+
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+/**
+ * Replaces a symbol table's slots with twice as many, and puts every symbol
+ * back into them. The old slots are left behind in the arena.
+ * 
+ * @param   context The context whose arena the table grows in.
+ * @param   symbols The symbol table to grow.
+ * @return  One if the table was grown, or zero if we're out of memory.
+ */
+static int
+grow_symbol_slots(plt_context* context, plt_symbol_table* symbols)
+{
+    const size_t slot_count = symbols->slot_count ? 2 * symbols->slot_count : 64;
+
+    size_t* slots = allocate(context, slot_count * sizeof(size_t));
+
+    if (!slots)
+        return 0;
+
+    for (size_t i = 0; i < slot_count; i++)
+        slots[i] = 0;
+
+    for (size_t symbol = 0; symbol < symbols->count; symbol++)
+    {
+        size_t slot = symbols->hashes[symbol] & (slot_count - 1);
+
+        while (slots[slot])
+            slot = (slot + 1) & (slot_count - 1);
+
+        slots[slot] = symbol + 1;
+    }
+
+    symbols->slots = slots;
+    symbols->slot_count = slot_count;
+
+    return 1;
+}
+
+/**
+ * Looks up the symbol ID of a name, interning the name first if it's new.
+ * 
+ * A new name is copied into the arena, so it doesn't have to outlive the call.
+ * 
+ * @param   context The context whose arena the table grows in.
+ * @param   symbols The symbol table to look the name up in.
+ * @param   name    The name. Doesn't have to be null terminated.
+ * @param   length  How many bytes the name is.
+ * @return  The name's symbol ID (or PLT_NO_SYMBOL if out of memory).
+ */
+size_t
+plt_intern(
+    plt_context* context,
+    plt_symbol_table* symbols,
+    const char* name,
+    const size_t length)
+{
+    const size_t hash = hash_symbol(name, length);
+
+    // Keep the table at most half full, so that probes stay short.
+    if (2 * (symbols->count + 1) > symbols->slot_count
+        && !grow_symbol_slots(context, symbols))
+        return PLT_NO_SYMBOL;
+
+    size_t slot = hash & (symbols->slot_count - 1);
+
+    for (; symbols->slots[slot]; slot = (slot + 1) & (symbols->slot_count - 1))
+    {
+        const size_t symbol = symbols->slots[slot] - 1;
+
+        if (symbols->hashes[symbol] == hash
+            && symbols->lengths[symbol] == length)
+        {
+            const char* existing_name = symbols->names[symbol];
+            size_t i = 0;
+
+            while (i < length && existing_name[i] == name[i])
+                i++;
+
+            if (i == length)
+                return symbol;
+        }
+    }
+
+    if (symbols->count == symbols->capacity)
+    {
+        const size_t capacity = symbols->capacity ? 2 * symbols->capacity : 64;
+
+        const char** names = reallocate(
+            context,
+            symbols->names,
+            capacity * sizeof(*symbols->names));
+        size_t* lengths = reallocate(
+            context,
+            symbols->lengths,
+            capacity * sizeof(*symbols->lengths));
+        size_t* hashes = reallocate(
+            context,
+            symbols->hashes,
+            capacity * sizeof(*symbols->hashes));
+
+        if (!names || !lengths || !hashes)
+            return PLT_NO_SYMBOL;
+
+        symbols->names = names;
+        symbols->lengths = lengths;
+        symbols->hashes = hashes;
+        symbols->capacity = capacity;
+    }
+
+    char* stored_name = plt_allocate_headerless(context, length + 1, 1);
+
+    if (!stored_name)
+        return PLT_NO_SYMBOL;
+
+    copy(name, length, stored_name);
+    stored_name[length] = '\0';
+
+    const size_t symbol = symbols->count++;
+    symbols->names[symbol] = stored_name;
+    symbols->lengths[symbol] = length;
+    symbols->hashes[symbol] = hash;
+    symbols->slots[slot] = symbol + 1;
+
+    return symbol;
+}
+
+/**
+ * Looks up the name of a symbol.
+ * 
+ * @param   symbols The symbol table the symbol was interned in.
+ * @param   symbol  The symbol ID.
+ * @return  The symbol's name, or null if there's no such symbol.
+ */
+const char*
+plt_symbol_name(const plt_symbol_table* symbols, const size_t symbol)
+{
+    return symbol < symbols->count ? symbols->names[symbol] : 0;
+}
+
+/// NUMBERS
+
+/**
+ * The value of a number literal.
+ */
+typedef struct plt_number_s {
+    // Whether the number is a flonum rather than a fixnum.
+    unsigned char is_flonum;
+    // Whether the literal has a minus sign.
+    unsigned char is_negative;
+    // The magnitude of a fixnum: a number without a fraction whose magnitude
+    // fits a size_t.
+    size_t fixnum;
+    // The value of a flonum: a number with a fraction, or too big to be a
+    // fixnum, correctly rounded to the nearest double.
+    double flonum;
+} plt_number;
+
+// How many significant digits of a flonum are read exactly. Any digits past
+// these can only break a tie, so they just count as "a little bit more".
+#define PLT_MAX_NUMBER_DIGITS 800
+
+// Enough 32-bit limbs for the biggest number decode_flonum() ever compares:
+// PLT_MAX_NUMBER_DIGITS digits, scaled by the smallest exponent that doesn't
+// round straight to zero.
+#define PLT_BIGNUM_LIMB_COUNT 144
+
+/**
+ * An arbitrary precision unsigned integer, just big enough for decoding
+ * flonums without allocating.
+ */
+typedef struct plt_bignum_s {
+    // The number's limbs, least significant first.
+    unsigned int limbs[PLT_BIGNUM_LIMB_COUNT];
+    // How many limbs are in use. Zero is no limbs at all.
+    size_t count;
+} plt_bignum;
+
+/**
+ * Multiplies a bignum by a small number and adds another to it.
+ * 
+ * @param   n   The bignum.
+ * @param   multiplier  What to multiply it by.
+ * @param   addend  What to add to it afterwards.
+ */
+static void
+bignum_multiply_add(
+    plt_bignum* n,
+    const unsigned int multiplier,
+    const unsigned int addend)
+{
+    unsigned long long carry = addend;
+
+    for (size_t i = 0; i < n->count; i++)
+    {
+        carry += (unsigned long long)n->limbs[i] * multiplier;
+        n->limbs[i] = (unsigned int)carry;
+        carry >>= 32;
+    }
+
+    if (carry)
+        n->limbs[n->count++] = (unsigned int)carry;
+}
+
+/**
+ * Multiplies a bignum by a power of ten.
+ * 
+ * @param   n   The bignum.
+ * @param   exponent    The power of ten.
+ */
+static void
+bignum_multiply_power_of_ten(plt_bignum* n, size_t exponent)
+{
+    for (; exponent >= 9; exponent -= 9)
+        bignum_multiply_add(n, 1000000000u, 0);
+
+    unsigned int multiplier = 1;
+
+    for (; exponent > 0; exponent--)
+        multiplier *= 10;
+
+    bignum_multiply_add(n, multiplier, 0);
+}
+
+/**
+ * Multiplies a bignum by a power of two.
+ * 
+ * @param   n   The bignum.
+ * @param   exponent    The power of two.
+ */
+static void
+bignum_shift_left(plt_bignum* n, const size_t exponent)
+{
+    if (!n->count)
+        return;
+
+    const size_t limb_shift = exponent / 32;
+    const unsigned int bit_shift = exponent % 32;
+
+    if (bit_shift)
+    {
+        n->limbs[n->count] = 0;
+
+        for (size_t i = n->count; i > 0; i--)
+            n->limbs[i] = (n->limbs[i] << bit_shift)
+                | (n->limbs[i - 1] >> (32 - bit_shift));
+
+        n->limbs[0] <<= bit_shift;
+
+        if (n->limbs[n->count])
+            n->count++;
+    }
+
+    for (size_t i = n->count; i > 0; i--)
+        n->limbs[i - 1 + limb_shift] = n->limbs[i - 1];
+
+    for (size_t i = 0; i < limb_shift; i++)
+        n->limbs[i] = 0;
+
+    n->count += limb_shift;
+}
+
+/**
+ * Compares two bignums.
+ * 
+ * @return  Less than, equal to or greater than zero, if a is less than, equal
+ *          to or greater than b.
+ */
+static int
+bignum_compare(const plt_bignum* a, const plt_bignum* b)
+{
+    if (a->count != b->count)
+        return a->count < b->count ? -1 : 1;
+
+    for (size_t i = a->count; i > 0; i--)
+        if (a->limbs[i - 1] != b->limbs[i - 1])
+            return a->limbs[i - 1] < b->limbs[i - 1] ? -1 : 1;
+
+    return 0;
+}
+
+/**
+ * The significant digits of a flonum literal, with its decimal point taken
+ * out: the literal's value is digits * 10^exponent.
+ */
+typedef struct plt_decimal_s {
+    // The literal.
+    const char* text;
+    // Where the first significant digit is.
+    size_t first;
+    // Where the digits stop, which may be before the literal does.
+    size_t last;
+    // How many digits there are between first and last.
+    size_t digit_count;
+    // The power of ten to scale the digits by.
+    long exponent;
+    // Whether nonzero digits were cut off past last.
+    int truncated;
+} plt_decimal;
+
+/**
+ * Compares a decimal with the point halfway between a double and the next
+ * double up.
+ * 
+ * @param   decimal The decimal.
+ * @param   bits    The double, as bits.
+ * @return  Less than, equal to or greater than zero, if the decimal is less
+ *          than, equal to or greater than the halfway point.
+ */
+static int
+compare_to_halfway(const plt_decimal* decimal, const unsigned long long bits)
+{
+    const unsigned long long fraction = bits & ((1ull << 52) - 1);
+    const long biased_exponent = (long)(bits >> 52);
+
+    // The double is mantissa * 2^(halfway_exponent + 1), and the halfway point
+    // is (2 * mantissa + 1) * 2^halfway_exponent.
+    const unsigned long long mantissa =
+        biased_exponent ? fraction | (1ull << 52) : fraction;
+    const long halfway_exponent =
+        (biased_exponent ? biased_exponent : 1) - 1075 - 1;
+
+    plt_bignum digits;
+    digits.count = 0;
+
+    for (size_t i = decimal->first; i < decimal->last; i++)
+        if (decimal->text[i] != '.')
+            bignum_multiply_add(
+                &digits,
+                10,
+                (unsigned int)(decimal->text[i] - '0'));
+
+    plt_bignum halfway;
+    halfway.count = 0;
+
+    const unsigned long long halfway_mantissa = 2 * mantissa + 1;
+    halfway.limbs[0] = (unsigned int)halfway_mantissa;
+    halfway.limbs[1] = (unsigned int)(halfway_mantissa >> 32);
+    halfway.count = halfway.limbs[1] ? 2 : 1;
+
+    // Scale both sides until they're integers.
+    if (decimal->exponent >= 0)
+        bignum_multiply_power_of_ten(&digits, (size_t)decimal->exponent);
+    else
+        bignum_multiply_power_of_ten(&halfway, (size_t)-decimal->exponent);
+
+    if (halfway_exponent >= 0)
+        bignum_shift_left(&halfway, (size_t)halfway_exponent);
+    else
+        bignum_shift_left(&digits, (size_t)-halfway_exponent);
+
+    const int comparison = bignum_compare(&digits, &halfway);
+
+    return comparison == 0 && decimal->truncated ? 1 : comparison;
+}
+
+/**
+ * Reinterprets the bits of a double as a double.
+ * 
+ * @param   bits    The bits.
+ * @return  The double.
+ */
+static double
+double_from_bits(const unsigned long long bits)
+{
+    double value;
+    copy((const char*)&bits, sizeof(value), (char*)&value);
+
+    return value;
+}
+
+// Every power of ten that is an exact double.
+static const double plt_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Decodes a number literal with a fraction (or too big for a fixnum) into the
+ * nearest double.
+ * 
+ * Most literals take Clinger's fast path: when the digits and the power of
+ * ten are both exact doubles, one multiplication or division rounds correctly.
+ * Everything else starts from a close estimate and checks it against the
+ * literal exactly with bignums, stepping a double at a time until it's right.
+ * 
+ * @param   text    The literal: digits with at most one decimal point.
+ * @param   length  How many bytes the literal is.
+ * @return  The nearest double.
+ */
+static double
+decode_flonum(const char* text, const size_t length)
+{
+    const unsigned long long infinity_bits = 0x7FFull << 52;
+
+    plt_decimal decimal;
+    decimal.text = text;
+    decimal.first = 0;
+    decimal.last = length;
+    decimal.truncated = 0;
+
+    size_t point = length;
+
+    for (size_t i = 0; i < length; i++)
+        if (text[i] == '.')
+            point = i;
+
+    // Leading and trailing zeros aren't significant.
+    while (decimal.first < length
+        && (text[decimal.first] == '0' || text[decimal.first] == '.'))
+        decimal.first++;
+
+    if (decimal.first == length)
+        return 0.0;
+
+    while (text[decimal.last - 1] == '0' || text[decimal.last - 1] == '.')
+        decimal.last--;
+
+    decimal.digit_count = decimal.last - decimal.first
+        - (decimal.first < point && point < decimal.last);
+    decimal.exponent = decimal.last <= point
+        ? (long)(point - decimal.last)
+        : -(long)(decimal.last - point - 1);
+
+    // Anything this big or small is out of range of a double.
+    if ((long)decimal.digit_count + decimal.exponent > 310)
+        return double_from_bits(infinity_bits);
+
+    if ((long)decimal.digit_count + decimal.exponent < -343)
+        return 0.0;
+
+    // Take the first 19 digits, which always fit a 64-bit integer.
+    unsigned long long leading_digits = 0;
+    size_t leading_count = 0;
+
+    for (size_t i = decimal.first; i < decimal.last && leading_count < 19; i++)
+    {
+        if (text[i] == '.')
+            continue;
+
+        leading_digits =
+            leading_digits * 10 + (unsigned long long)(text[i] - '0');
+        leading_count++;
+    }
+
+    const long leading_exponent =
+        decimal.exponent + (long)(decimal.digit_count - leading_count);
+
+    if (leading_count == decimal.digit_count
+        && leading_digits <= (1ull << 53))
+    {
+        if (decimal.exponent >= 0 && decimal.exponent <= 22)
+            return (double)leading_digits
+                * plt_powers_of_ten[decimal.exponent];
+
+        if (decimal.exponent < 0 && decimal.exponent >= -22)
+            return (double)leading_digits
+                / plt_powers_of_ten[-decimal.exponent];
+    }
+
+    // Too many digits to read exactly, so drop the rest.
+    if (decimal.digit_count > PLT_MAX_NUMBER_DIGITS)
+    {
+        size_t kept_count = 0;
+        size_t i = decimal.first;
+
+        for (; kept_count < PLT_MAX_NUMBER_DIGITS; i++)
+            if (text[i] != '.')
+                kept_count++;
+
+        decimal.exponent += (long)(decimal.digit_count - kept_count);
+        decimal.digit_count = kept_count;
+        decimal.last = i;
+        decimal.truncated = 1;
+    }
+
+    // Estimate the double from the leading digits, within a few units in the
+    // last place.
+    double estimate = (double)leading_digits;
+    long exponent = leading_exponent;
+
+    for (; exponent > 22; exponent -= 22)
+        estimate *= 1e22;
+
+    for (; exponent < -22; exponent += 22)
+        estimate /= 1e22;
+
+    estimate = exponent >= 0
+        ? estimate * plt_powers_of_ten[exponent]
+        : estimate / plt_powers_of_ten[-exponent];
+
+    unsigned long long bits;
+    copy((const char*)&estimate, sizeof(bits), (char*)&bits);
+
+    if (bits > infinity_bits)
+        bits = infinity_bits;
+
+    // Step up while the literal is past the halfway point above the double,
+    // then down while it's before the halfway point below it. Exact ties go
+    // to the double with the even mantissa.
+    for (;;)
+    {
+        if (bits < infinity_bits)
+        {
+            const int comparison = compare_to_halfway(&decimal, bits);
+
+            if (comparison > 0 || (comparison == 0 && (bits & 1)))
+            {
+                bits++;
+                continue;
+            }
+        }
+
+        if (bits > 0)
+        {
+            const int comparison = compare_to_halfway(&decimal, bits - 1);
+
+            if (comparison < 0 || (comparison == 0 && (bits & 1)))
+            {
+                bits--;
+                continue;
+            }
+        }
+
+        break;
+    }
+
+    return double_from_bits(bits);
+}
+
+/**
+ * The digits of a number literal, gathered as it's read so that the digits
+ * only have to be looked at once.
+ */
+typedef struct plt_number_digits_s {
+    // The literal's digits as an integer, ignoring any decimal point.
+    size_t mantissa;
+    // How many of the digits come after the decimal point.
+    size_t fraction_digits;
+    // Whether the literal has a decimal point.
+    unsigned char has_point;
+    // Whether the digits stopped fitting the mantissa.
+    unsigned char overflowed;
+} plt_number_digits;
+
+/**
+ * Adds a run of digits to a number literal's digits.
+ * 
+ * @param   digits  The digits so far. Digits after a decimal point are counted
+ *                  as the fraction.
+ * @param   text    The text holding the run.
+ * @param   offset  Where the run starts.
+ * @param   length  How long the entire text is.
+ * @return  The offset of the first byte that isn't a digit.
+ */
+static size_t
+accumulate_digits(
+    plt_number_digits* digits,
+    const char* text,
+    size_t offset,
+    const size_t length)
+{
+    const size_t start = offset;
+    size_t mantissa = digits->mantissa;
+
+    for (; offset < length && is_digit(text[offset]); offset++)
+    {
+        const size_t digit = (size_t)(text[offset] - '0');
+
+        if (mantissa > ((size_t)-1 - digit) / 10)
+            digits->overflowed = 1;
+
+        mantissa = mantissa * 10 + digit;
+    }
+
+    digits->mantissa = mantissa;
+
+    if (digits->has_point)
+        digits->fraction_digits += offset - start;
+
+    return offset;
+}
+
+/**
+ * Works out the value of a number literal from its digits.
+ * 
+ * Fixnums come straight from the mantissa, and so do flonums whose mantissa
+ * and power of ten are both exact doubles. Only the rest go back over the
+ * literal's text with decode_flonum().
+ * 
+ * @param   digits  The literal's digits.
+ * @param   text    The literal itself.
+ * @param   length  How many bytes the literal is.
+ * @return  The literal's value.
+ */
+static plt_number
+number_from_digits(
+    const plt_number_digits* digits,
+    const char* text,
+    const size_t length)
+{
+    // The digits leave out the sign, which can only be the first byte.
+    const size_t sign_length = length && (text[0] == '+' || text[0] == '-');
+
+    plt_number number;
+    number.is_flonum = 0;
+    number.is_negative = sign_length && text[0] == '-';
+    number.fixnum = 0;
+    number.flonum = 0.0;
+
+    if (!digits->has_point && !digits->overflowed)
+    {
+        number.fixnum = digits->mantissa;
+        return number;
+    }
+
+    number.is_flonum = 1;
+
+    if (!digits->overflowed
+        && digits->mantissa <= (1ull << 53)
+        && digits->fraction_digits <= 22)
+    {
+        number.flonum = (double)digits->mantissa
+            / plt_powers_of_ten[digits->fraction_digits];
+    }
+    else
+    {
+        number.flonum =
+            decode_flonum(text + sign_length, length - sign_length);
+    }
+
+    if (number.is_negative)
+        number.flonum = -number.flonum;
+
+    return number;
+}
+
+/**
+ * Decodes a number literal, such as the text of a PLT_TOKEN_NUMBER token.
+ * 
+ * Literals without a fraction become fixnums, as long as their magnitude fits
+ * a size_t. Everything else becomes a correctly rounded flonum.
+ * 
+ * @param   text    The literal: an optional sign, then digits with at most one
+ *                  decimal point.
+ * @param   length  How many bytes the literal is.
+ * @return  The literal's value.
+ */
+plt_number
+plt_decode_number(const char* text, const size_t length)
+{
+    plt_number_digits digits = { 0 };
+    const size_t sign_length = length && (text[0] == '+' || text[0] == '-');
+    size_t i = accumulate_digits(&digits, text, sign_length, length);
+
+    if (i < length && text[i] == '.')
+    {
+        digits.has_point = 1;
+        i = accumulate_digits(&digits, text, i + 1, length);
+    }
+
+    // Leave anything else to the exact decoder.
+    if (i < length)
+        digits.overflowed = 1;
+
+    return number_from_digits(&digits, text, length);
+}
+
+/// LEXING
+
+/**
+ * Stores Pilot Scheme's lexer state for a source string.
+ */
+typedef struct plt_lexer_s {
+    // A stretchy buffer used to temporarily store the text value of a token.
+    char* buffer;
+    // Where the lexer is currently located in the source string.
+    size_t cursor_offset;
+    // The state machine's state partway through a token, when lexing a source
+    // that arrives in chunks (an enum plt_lexer_state).
+    unsigned char state;
+    // Where to intern identifiers as they're lexed, if anywhere.
+    plt_symbol_table* symbols;
+    // The digits of the number being lexed, gathered as the lexer goes.
+    plt_number_digits digits;
+    // Whether the buffer couldn't fit part of the token being lexed from
+    // chunks, in which case the token has lost some of its text.
+    unsigned char out_of_memory;
+} plt_lexer;
+
+/**
+ * Stores data on a token extracted from a source string.
+ */
+typedef struct plt_token_s {
+    // Snippet of the source code this token represents.
+    const char* text;
+
+    #define TOKEN_TYPES \
+        _(INVALID) \
+        _(LIST_START) \
+        _(LIST_END) \
+        _(QUOTE) \
+        _(NUMBER) \
+        _(IDENT) \
+        _(BOOLEAN) \
+        _(UNKNOWN) \
+        _(EOF)
+
+    // The type of token.
+    enum plt_token_type {
+        #define _(T) PLT_TOKEN_ ## T,
+        TOKEN_TYPES
+        #undef _
+    } type;
+
+    // The symbol ID of an identifier, if the lexer has a symbol table.
+    // Otherwise (or if out of memory), PLT_NO_SYMBOL.
+    size_t symbol;
+
+    // The value of a number. Zero for every other token.
+    plt_number number;
+} plt_token;
+
+/**
+ * Returns the string representation of the token type.
+ * 
+ * @param token_type    The type of the token.
+ * @return  A string representation of the token type.
+ */
+const char*
+plt_token_type_to_string(enum plt_token_type token_type)
+{
+    switch (token_type)
+    {
+        #define _(T) case PLT_TOKEN_ ## T: return #T;
+        TOKEN_TYPES
+        #undef _
+
+        default:
+            return "UNDEFINED";
+    }
+}
+
+/**
+ * Stores the location of a token within a source string.
+ * 
+ * Unlike plt_token, a slice doesn't copy any of the source code; it just
+ * remembers where the token lives, so the source must outlive the slice.
+ */
+typedef struct plt_token_slice_s {
+    // Where the token starts in the source string.
+    size_t offset;
+    // How many bytes of the source string the token spans.
+    size_t length;
+    // The type of token.
+    enum plt_token_type type;
+} plt_token_slice;
+
+/**
+ * The classes of characters the lexer tells apart. Every byte of the source
+ * falls into exactly one of them.
+ */
+enum plt_char_class {
+    // Anything we don't know how to lex yet (strings, comments, etc.)
+    PLT_CHAR_OTHER,
+    PLT_CHAR_WHITESPACE,
+    PLT_CHAR_LIST_START,
+    PLT_CHAR_LIST_END,
+    PLT_CHAR_QUOTE,
+    PLT_CHAR_DIGIT,
+    PLT_CHAR_DOT,
+    // Letters, Scheme's extended identifier characters and UTF8 bytes.
+    PLT_CHAR_IDENT,
+    // + and -, which start identifiers unless a digit comes next.
+    PLT_CHAR_SIGN,
+    PLT_CHAR_HASH,
+
+    PLT_CHAR_CLASS_COUNT
+};
+
+/**
+ * Maps every byte onto its character class.
+ * 
+ * NOTE: We want UTF8 support and Lisps allow crazy things as identifiers, so
+ * every byte of a multibyte UTF8 sequence (0x80 and up) is an identifier
+ * character. That keeps multibyte identifiers in one piece until we decide
+ * how to validate them.
+ */
+static const unsigned char plt_char_classes[256] = {
+    #define OT PLT_CHAR_OTHER
+    #define WS PLT_CHAR_WHITESPACE
+    #define LS PLT_CHAR_LIST_START
+    #define LE PLT_CHAR_LIST_END
+    #define QT PLT_CHAR_QUOTE
+    #define DG PLT_CHAR_DIGIT
+    #define DT PLT_CHAR_DOT
+    #define ID PLT_CHAR_IDENT
+    #define SG PLT_CHAR_SIGN
+    #define HS PLT_CHAR_HASH
+
+    OT, OT, OT, OT, OT, OT, OT, OT, OT, WS, WS, OT, OT, WS, OT, OT,
+    OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT, OT,
+    WS, ID, OT, HS, ID, ID, ID, QT, LS, LE, ID, SG, OT, SG, DT, ID,
+    DG, DG, DG, DG, DG, DG, DG, DG, DG, DG, ID, OT, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, OT, OT, OT, ID, ID,
+    OT, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, OT, OT, OT, ID, OT,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,
+
+    #undef OT
+    #undef WS
+    #undef LS
+    #undef LE
+    #undef QT
+    #undef DG
+    #undef DT
+    #undef ID
+    #undef SG
+    #undef HS
+};
+
+/**
+ * The states of the lexer's state machine. Every state except START accepts,
+ * so a token always ends at the first byte its state can't take; the lexer
+ * never has to back up.
+ */
+enum plt_lexer_state {
+    PLT_LEXER_START,
+    PLT_LEXER_LIST_START,
+    PLT_LEXER_LIST_END,
+    PLT_LEXER_QUOTE,
+    PLT_LEXER_NUMBER,
+    PLT_LEXER_FRACTION,
+    PLT_LEXER_SIGN,
+    PLT_LEXER_IDENT,
+    PLT_LEXER_HASH,
+    PLT_LEXER_BOOLEAN,
+    PLT_LEXER_UNKNOWN,
+    // Not a real state: the current token ended before this byte.
+    PLT_LEXER_DONE,
+
+    PLT_LEXER_STATE_COUNT = PLT_LEXER_DONE
+};
+
+/**
+ * The lexer's state machine, indexed by the current state and the character
+ * class of the next byte. To add a new kind of token, add a state, a row and
+ * an entry in plt_lexer_state_tokens.
+ */
+static const unsigned char
+plt_lexer_transitions[PLT_LEXER_STATE_COUNT][PLT_CHAR_CLASS_COUNT] = {
+    #define __ PLT_LEXER_DONE
+
+    // Columns: OTHER, WHITESPACE, LIST_START, LIST_END, QUOTE, DIGIT, DOT,
+    // IDENT, SIGN and HASH.
+    [PLT_LEXER_START] = {
+        PLT_LEXER_UNKNOWN,
+        __,
+        PLT_LEXER_LIST_START,
+        PLT_LEXER_LIST_END,
+        PLT_LEXER_QUOTE,
+        PLT_LEXER_NUMBER,
+        PLT_LEXER_IDENT,
+        PLT_LEXER_IDENT,
+        PLT_LEXER_SIGN,
+        PLT_LEXER_HASH
+    },
+    [PLT_LEXER_LIST_START] = { __, __, __, __, __, __, __, __, __, __ },
+    [PLT_LEXER_LIST_END] = { __, __, __, __, __, __, __, __, __, __ },
+    [PLT_LEXER_QUOTE] = { __, __, __, __, __, __, __, __, __, __ },
+    [PLT_LEXER_NUMBER] = {
+        __, __, __, __, __, PLT_LEXER_NUMBER, PLT_LEXER_FRACTION, __, __, __
+    },
+    [PLT_LEXER_FRACTION] = {
+        __, __, __, __, __, PLT_LEXER_FRACTION, __, __, __, __
+    },
+    // A sign is an identifier of its own (+, -, ->), unless it's a number's.
+    [PLT_LEXER_SIGN] = {
+        __,
+        __,
+        __,
+        __,
+        __,
+        PLT_LEXER_NUMBER,
+        PLT_LEXER_IDENT,
+        PLT_LEXER_IDENT,
+        PLT_LEXER_IDENT,
+        __
+    },
+    [PLT_LEXER_IDENT] = {
+        __,
+        __,
+        __,
+        __,
+        __,
+        PLT_LEXER_IDENT,
+        PLT_LEXER_IDENT,
+        PLT_LEXER_IDENT,
+        PLT_LEXER_IDENT,
+        __
+    },
+    [PLT_LEXER_HASH] = {
+        __, __, __, __, __, __, __, PLT_LEXER_BOOLEAN, __, __
+    },
+    // The name after the #, which only the reader can tell is #t, #f, #true
+    // or #false.
+    [PLT_LEXER_BOOLEAN] = {
+        __,
+        __,
+        __,
+        __,
+        __,
+        PLT_LEXER_BOOLEAN,
+        PLT_LEXER_BOOLEAN,
+        PLT_LEXER_BOOLEAN,
+        PLT_LEXER_BOOLEAN,
+        __
+    },
+    [PLT_LEXER_UNKNOWN] = { __, __, __, __, __, __, __, __, __, __ },
+
+    #undef __
+};
+
+/**
+ * The type of token produced when a token ends in each state.
+ */
+static const unsigned char plt_lexer_state_tokens[PLT_LEXER_STATE_COUNT] = {
+    [PLT_LEXER_START] = PLT_TOKEN_EOF,
+    [PLT_LEXER_LIST_START] = PLT_TOKEN_LIST_START,
+    [PLT_LEXER_LIST_END] = PLT_TOKEN_LIST_END,
+    [PLT_LEXER_QUOTE] = PLT_TOKEN_QUOTE,
+    [PLT_LEXER_NUMBER] = PLT_TOKEN_NUMBER,
+    [PLT_LEXER_FRACTION] = PLT_TOKEN_NUMBER,
+    [PLT_LEXER_SIGN] = PLT_TOKEN_IDENT,
+    [PLT_LEXER_IDENT] = PLT_TOKEN_IDENT,
+    [PLT_LEXER_HASH] = PLT_TOKEN_UNKNOWN,
+    [PLT_LEXER_BOOLEAN] = PLT_TOKEN_BOOLEAN,
+    [PLT_LEXER_UNKNOWN] = PLT_TOKEN_UNKNOWN,
+};
+
+/**
+ * Runs the lexer's state machine over the source until the current token ends
+ * or the source runs out, whichever comes first.
+ * 
+ * Runs of digits and plain identifier characters are skipped with the
+ * vectorized scanners before falling back on the transition table. When the
+ * caller wants the value of a number, its digits are read into it instead.
+ * 
+ * @param   state   The state to start in. Updated to the state the token ended
+ *                  in.
+ * @param   source  A pointer to the source code we are currently lexing.
+ * @param   offset  Where in the source to pick up from.
+ * @param   source_length   How long the entire source code string is.
+ * @param   digits  Where to gather the digits of a number token, or null to
+ *                  skip over them.
+ * @return  The offset of the first byte that isn't part of the token.
+ */
+static size_t
+lex_run(
+    unsigned char* state,
+    const char* source,
+    size_t offset,
+    const size_t source_length,
+    plt_number_digits* digits)
+{
+    unsigned char current = *state;
+
+    while (offset < source_length)
+    {
+        if (current == PLT_LEXER_IDENT)
+            offset = scan_alphanum(source, offset, source_length);
+        else if (current == PLT_LEXER_NUMBER || current == PLT_LEXER_FRACTION)
+            offset = digits
+                ? accumulate_digits(digits, source, offset, source_length)
+                : scan_digits(source, offset, source_length);
+
+        if (offset >= source_length)
+            break;
+
+        const unsigned char next = plt_lexer_transitions[current]
+            [plt_char_classes[(unsigned char)source[offset]]];
+
+        if (next == PLT_LEXER_DONE)
+            break;
+
+        if (digits && next == PLT_LEXER_FRACTION)
+            digits->has_point = 1;
+
+        // A number's first digit is left for the scan above, so that it
+        // counts towards the number's value.
+        if (next != PLT_LEXER_NUMBER || current == PLT_LEXER_NUMBER)
+            offset++;
+
+        current = next;
+    }
+
+    *state = current;
+
+    return offset;
+}
+
+/**
+ * Finds the next token in the source code, gathering its digits if it's a
+ * number and the caller wants them.
+ * 
+ * @param   lexer   A pointer to the current lexer.
+ * @param   source  A pointer to the source code we are currently lexing.
+ * @param   source_length   How long the entire source code string is.
+ * @param   digits  Where to gather the digits of a number, or null.
+ * @return  The slice of the source the token spans.
+ */
+static plt_token_slice
+next_token_slice(
+    plt_lexer* lexer,
+    const char* source,
+    const size_t source_length,
+    plt_number_digits* digits)
+{
+    // Skip whitespace.
+    lexer->cursor_offset = scan_whitespace(
+        source,
+        lexer->cursor_offset,
+        source_length);
+
+    unsigned char state = PLT_LEXER_START;
+
+    plt_token_slice t;
+    t.offset = lexer->cursor_offset;
+
+    lexer->cursor_offset = lex_run(
+        &state,
+        source,
+        lexer->cursor_offset,
+        source_length,
+        digits);
+
+    t.length = lexer->cursor_offset - t.offset;
+    t.type = plt_lexer_state_tokens[state];
+
+    return t;
+}
+
+/**
+ * Retrieves the location of the next token in the source code provided.
+ * 
+ * Works just like plt_next_token(), except that nothing is copied into the
+ * lexer's buffer and nothing is allocated from the arena. If we're at the end
+ * of the source, then an EOF slice of length zero is returned to the caller.
+ * 
+ * Every token other than EOF is at least one byte long, so a byte the lexer
+ * doesn't understand comes back as a one byte PLT_TOKEN_UNKNOWN.
+ * 
+ * @param   lexer   A pointer to the current lexer.
+ * @param   source  A pointer to the source code we are currently lexing.
+ * @param   source_length   How long the entire source code string is.
+ * @return  The slice of the source the token spans.
+ */
+plt_token_slice
+plt_next_token_slice(
+    plt_lexer* lexer,
+    const char* source,
+    const size_t source_length)
+{
+    return next_token_slice(lexer, source, source_length, 0);
+}
+
+/**
+ * Copies the text a token slice spans into a fresh, null terminated string.
+ * 
+ * This is the only part of slice lexing that touches the arena, so only call
+ * it for the tokens you actually need the text of.
+ * 
+ * @param   context The context whose arena the string is allocated from.
+ * @param   slice   The slice to copy out of the source.
+ * @param   source  The source code the slice was lexed from.
+ * @return  A null terminated copy of the token's text (or null if out of
+ *          memory).
+ */
+char*
+plt_token_slice_to_string(
+    plt_context* context,
+    const plt_token_slice slice,
+    const char* source)
+{
+    char* string = allocate(context, slice.length + 1);
+
+    if (string)
+    {
+        copy(source + slice.offset, slice.length, string);
+        string[slice.length] = '\0';
+    }
+
+    return string;
+}
+
+/**
+ * Works out what a finished token means: interns identifiers into the lexer's
+ * symbol table, if it has one, and works out numbers from the digits the lexer
+ * gathered.
+ * 
+ * @param   context The context whose arena the symbol table grows in.
+ * @param   lexer   The lexer whose buffer holds the token's text.
+ * @param   t   The token.
+ */
+static void
+finish_token(plt_context* context, const plt_lexer* lexer, plt_token* t)
+{
+    if (!t->text)
+        return;
+
+    if (t->type == PLT_TOKEN_IDENT && lexer->symbols)
+        t->symbol = plt_intern(
+            context,
+            lexer->symbols,
+            t->text,
+            buffer_count(lexer->buffer));
+    else if (t->type == PLT_TOKEN_NUMBER)
+        t->number = number_from_digits(
+            &lexer->digits,
+            t->text,
+            buffer_count(lexer->buffer));
+}
+
+/**
+ * Retrieves the next token from the source code provided.
+ * 
+ * Using the given lexer for context, we grab the next token waiting in the
+ * source code. If we're at the end of the source, then an invalid token is
+ * returned to the caller.
+ * 
+ * The token's text lives in the lexer's buffer, so it is overwritten by the
+ * next call. Use plt_next_token_slice() to skip that copy altogether. If the
+ * buffer can't grow to fit the token, the token's text is null.
+ * 
+ * Identifiers are interned as they're lexed when the lexer has a symbol table,
+ * and numbers come with their value already decoded.
+ * 
+ * @param   context The context whose arena the lexer's buffer grows in.
+ * @param   lexer   A pointer to the current lexer.
+ * @param   source  A pointer to the source code we are currently lexing.
+ * @param   source_length   How long the entire source code string is.
+ * @return  The token extracted from the source.
+ */
+plt_token
+plt_next_token(
+    plt_context* context,
+    plt_lexer* lexer,
+    const char* source,
+    const size_t source_length)
+{
+    lexer->digits = (plt_number_digits){ 0 };
+
+    const plt_token_slice slice =
+        next_token_slice(lexer, source, source_length, &lexer->digits);
+
+    plt_token t;
+    t.text = 0;
+    t.type = slice.type;
+    t.symbol = PLT_NO_SYMBOL;
+    t.number.is_flonum = 0;
+    t.number.is_negative = 0;
+    t.number.fixnum = 0;
+    t.number.flonum = 0.0;
+
+    if (slice.type != PLT_TOKEN_EOF)
+    {
+        buffer_reset(lexer->buffer);
+
+        char* text = buffer_add_n(context, lexer->buffer, slice.length);
+
+        // Running out of memory leaves the text null.
+        if (text)
+        {
+            copy(source + slice.offset, slice.length, text);
+            t.text = lexer->buffer;
+        }
+
+        finish_token(context, lexer, &t);
+    }
+
+    return t;
+}
+
+/**
+ * Retrieves the next token from source code that arrives in chunks.
+ * 
+ * Call this repeatedly with the same chunk until it returns
+ * PLT_TOKEN_INVALID, which means the chunk has been used up, then call it with
+ * the next chunk. A token that runs off the end of a chunk is saved in the
+ * lexer and finished off by the following chunk, so chunks can be split
+ * anywhere and don't have to outlive the call. Pass an empty chunk once the
+ * input is over to flush the last token and get an EOF token.
+ * 
+ * The token's text lives in the lexer's buffer, just like plt_next_token(),
+ * and is null if the buffer couldn't grow to fit any part of the token.
+ * Identifiers and numbers are handled just like plt_next_token() does, too.
+ * 
+ * @param   context The context whose arena the lexer's buffer grows in.
+ * @param   lexer   A pointer to the current lexer.
+ * @param   chunk   A pointer to the current chunk of source code.
+ * @param   chunk_length    How long the current chunk is (zero at the end of
+ *                          the input).
+ * @return  The token extracted from the source, or an invalid token if the
+ *          chunk ran out first.
+ */
+plt_token
+plt_next_token_chunk(
+    plt_context* context,
+    plt_lexer* lexer,
+    const char* chunk,
+    const size_t chunk_length)
+{
+    plt_token t;
+    t.text = 0;
+    t.type = PLT_TOKEN_INVALID;
+    t.symbol = PLT_NO_SYMBOL;
+    t.number.is_flonum = 0;
+    t.number.is_negative = 0;
+    t.number.fixnum = 0;
+    t.number.flonum = 0.0;
+
+    // The input is over, so whatever token we were in the middle of is done.
+    if (chunk_length == 0)
+    {
+        t.type = plt_lexer_state_tokens[lexer->state];
+
+        if (lexer->state != PLT_LEXER_START && !lexer->out_of_memory)
+            t.text = lexer->buffer;
+
+        finish_token(context, lexer, &t);
+
+        lexer->state = PLT_LEXER_START;
+        lexer->cursor_offset = 0;
+        lexer->out_of_memory = 0;
+
+        return t;
+    }
+
+    // Only throw away the buffer once we're between tokens, since it holds
+    // the start of any token left unfinished by the previous chunk.
+    if (lexer->state == PLT_LEXER_START)
+    {
+        buffer_reset(lexer->buffer);
+        lexer->digits = (plt_number_digits){ 0 };
+        lexer->out_of_memory = 0;
+
+        lexer->cursor_offset = scan_whitespace(
+            chunk,
+            lexer->cursor_offset,
+            chunk_length);
+    }
+
+    unsigned char state = lexer->state;
+    const size_t start = lexer->cursor_offset;
+
+    lexer->cursor_offset = lex_run(
+        &state,
+        chunk,
+        lexer->cursor_offset,
+        chunk_length,
+        &lexer->digits);
+
+    // Once part of the token is lost, there's no point keeping the rest.
+    if (!lexer->out_of_memory)
+    {
+        char* text =
+            buffer_add_n(context, lexer->buffer, lexer->cursor_offset - start);
+
+        if (text)
+            copy(chunk + start, lexer->cursor_offset - start, text);
+        else
+            lexer->out_of_memory = 1;
+    }
+
+    // The token ended before the chunk did.
+    if (lexer->cursor_offset < chunk_length)
+    {
+        // Running out of memory on any of its chunks leaves the text null.
+        if (!lexer->out_of_memory)
+            t.text = lexer->buffer;
+
+        t.type = plt_lexer_state_tokens[state];
+
+        finish_token(context, lexer, &t);
+
+        lexer->state = PLT_LEXER_START;
+
+        return t;
+    }
+
+    // The chunk ran out first. Remember how far into the token we got and
+    // start the next chunk from its beginning.
+    lexer->state = state;
+    lexer->cursor_offset = 0;
+
+    return t;
+}
+
+/// BULK LEXING
+
+/**
+ * Stores every token of a source string as parallel arrays, so that later
+ * stages can walk the tokens linearly without calling back into the lexer.
+ * 
+ * Token i is described by types[i], offsets[i] and lengths[i], just like a
+ * plt_token_slice. The last token is always PLT_TOKEN_EOF.
+ */
+typedef struct plt_token_stream_s {
+    // The type of each token (an enum plt_token_type).
+    unsigned char* types;
+    // Where each token starts in the source string.
+    size_t* offsets;
+    // How many bytes of the source string each token spans.
+    size_t* lengths;
+    // How many tokens are in the stream, including the EOF token.
+    size_t count;
+    // How many tokens the arrays have room for.
+    size_t capacity;
+} plt_token_stream;
+
+/**
+ * Grows the arrays of a token stream so they hold at least the given number of
+ * tokens.
+ * 
+ * @param   context The context whose arena the stream grows in.
+ * @param   stream  The stream to grow.
+ * @param   capacity    The number of tokens the stream needs room for.
+ * @return  One if the stream was grown, or zero if we're out of memory.
+ */
+static int
+grow_token_stream(
+    plt_context* context,
+    plt_token_stream* stream,
+    const size_t capacity)
+{
+    unsigned char* types = reallocate(
+        context,
+        stream->types,
+        capacity * sizeof(*stream->types));
+    size_t* offsets = reallocate(
+        context,
+        stream->offsets,
+        capacity * sizeof(*stream->offsets));
+    size_t* lengths = reallocate(
+        context,
+        stream->lengths,
+        capacity * sizeof(*stream->lengths));
+
+    if (!types || !offsets || !lengths)
+        return 0;
+
+    stream->types = types;
+    stream->offsets = offsets;
+    stream->lengths = lengths;
+    stream->capacity = capacity;
+
+    return 1;
+}
+
+/**
+ * Lexes an entire source string in one go.
+ * 
+ * Produces exactly the tokens that repeatedly calling plt_next_token_slice()
+ * would, including the closing EOF token, but without the per token call and
+ * without copying any text. The token arrays are allocated from the arena.
+ * 
+ * @param   context The context whose arena the stream is allocated from.
+ * @param   source  A pointer to the source code to lex.
+ * @param   source_length   How long the entire source code string is.
+ * @param   stream  The stream to fill. Should be zero initialized.
+ * @return  The number of tokens in the stream (or zero if out of memory).
+ */
+size_t
+plt_tokenize(
+    plt_context* context,
+    const char* source,
+    const size_t source_length,
+    plt_token_stream* stream)
+{
+    // Most real sources average well over four bytes per token, counting the
+    // whitespace between them, so this rarely needs to grow.
+    if (!grow_token_stream(context, stream, source_length / 4 + 16))
+        return 0;
+
+    size_t count = 0;
+    size_t cursor = 0;
+
+    for (;;)
+    {
+        if (count == stream->capacity
+            && !grow_token_stream(context, stream, stream->capacity * 2))
+        {
+            return 0;
+        }
+
+        cursor = scan_whitespace(source, cursor, source_length);
+
+        unsigned char state = PLT_LEXER_START;
+        const size_t start = cursor;
+
+        cursor = lex_run(&state, source, cursor, source_length, 0);
+
+        stream->types[count] = plt_lexer_state_tokens[state];
+        stream->offsets[count] = start;
+        stream->lengths[count] = cursor - start;
+        count++;
+
+        if (state == PLT_LEXER_START)
+            break;
+    }
+
+    stream->count = count;
+
+    return count;
+}
+
+/// PARALLEL LEXING
+
+// Threads need the operating system's headers, so consumers have to ask for
+// them by defining PILOT_ENABLE_THREADS (and link against pthreads on POSIX).
+#ifdef PILOT_ENABLE_THREADS
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// The most threads plt_tokenize_parallel() will split a source across.
+#ifndef PILOT_MAX_THREADS
+#define PILOT_MAX_THREADS 64
+#endif
+
+// The smallest piece of source worth handing to its own thread.
+#ifndef PILOT_MIN_PARALLEL_CHUNK
+#define PILOT_MIN_PARALLEL_CHUNK (64 * 1024)
+#endif
+
+/**
+ * A range of the source lexed by one thread.
+ */
+typedef struct plt_lex_range_s {
+    const char* source;
+    // Where the range starts and ends. Both are token boundaries.
+    size_t begin;
+    size_t end;
+    // Where to write the range's tokens, or null to only count them.
+    unsigned char* types;
+    size_t* offsets;
+    size_t* lengths;
+    // How many tokens start in the range.
+    size_t count;
+} plt_lex_range;
+
+/**
+ * Decides if the lexer is always between tokens at a byte of the given class.
+ * That's true when every state but START ends its token on the class, which
+ * the transition table can tell us.
+ * 
+ * @param   class   The character class of the byte.
+ * @return  One if a token can't run through the byte, otherwise zero.
+ */
+static int
+is_token_boundary(const unsigned char class)
+{
+    for (int state = PLT_LEXER_START + 1; state < PLT_LEXER_STATE_COUNT; state++)
+        if (plt_lexer_transitions[state][class] != PLT_LEXER_DONE)
+            return 0;
+
+    return 1;
+}
+
+/**
+ * Finds the first token boundary at or after an offset.
+ * 
+ * @param   source  A pointer to the source code.
+ * @param   offset  Where to start looking.
+ * @param   source_length   How long the entire source code string is.
+ * @return  The offset of the boundary (or the source length if there are
+ *          none left).
+ */
+static size_t
+find_token_boundary(
+    const char* source,
+    size_t offset,
+    const size_t source_length)
+{
+    while (offset < source_length
+        && !is_token_boundary(plt_char_classes[(unsigned char)source[offset]]))
+    {
+        offset++;
+    }
+
+    return offset;
+}
+
+/**
+ * Lexes every token in a range, writing them out if the range has somewhere
+ * to put them and counting them either way.
+ * 
+ * @param   range   The range to lex.
+ */
+static void
+tokenize_range(plt_lex_range* range)
+{
+    size_t count = 0;
+    size_t cursor = range->begin;
+
+    while (cursor < range->end)
+    {
+        cursor = scan_whitespace(range->source, cursor, range->end);
+
+        if (cursor >= range->end)
+            break;
+
+        unsigned char state = PLT_LEXER_START;
+        const size_t start = cursor;
+
+        cursor = lex_run(&state, range->source, cursor, range->end, 0);
+
+        if (range->types)
+        {
+            range->types[count] = plt_lexer_state_tokens[state];
+            range->offsets[count] = start;
+            range->lengths[count] = cursor - start;
+        }
+
+        count++;
+    }
+
+    range->count = count;
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI
+tokenize_range_thread(LPVOID range)
+{
+    tokenize_range(range);
+    return 0;
+}
+#else
+static void*
+tokenize_range_thread(void* range)
+{
+    tokenize_range(range);
+    return 0;
+}
+#endif
+
+/**
+ * Lexes every range on its own thread, with the calling thread taking the
+ * last one. If a thread can't be started, its range is lexed by the caller.
+ * 
+ * @param   ranges  The ranges to lex.
+ * @param   range_count How many ranges there are.
+ */
+static void
+tokenize_ranges(plt_lex_range* ranges, const int range_count)
+{
+    #if defined(_WIN32)
+    HANDLE threads[PILOT_MAX_THREADS];
+    #else
+    pthread_t threads[PILOT_MAX_THREADS];
+    #endif
+    int started[PILOT_MAX_THREADS];
+
+    for (int i = 0; i < range_count - 1; i++)
+    {
+        #if defined(_WIN32)
+        threads[i] = CreateThread(0, 0, tokenize_range_thread, &ranges[i], 0, 0);
+        started[i] = threads[i] != 0;
+        #else
+        started[i] = pthread_create(
+            &threads[i],
+            0,
+            tokenize_range_thread,
+            &ranges[i]) == 0;
+        #endif
+
+        if (!started[i])
+            tokenize_range(&ranges[i]);
+    }
+
+    tokenize_range(&ranges[range_count - 1]);
+
+    for (int i = 0; i < range_count - 1; i++)
+    {
+        if (!started[i])
+            continue;
+
+        #if defined(_WIN32)
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+        #else
+        pthread_join(threads[i], 0);
+        #endif
+    }
+}
+
+/**
+ * Lexes an entire source string across several threads.
+ * 
+ * Produces exactly the same stream as plt_tokenize(). Every thread lexes its
+ * own piece of the source starting from the lexer's START state, which is only
+ * a guess in the middle of a token. So before lexing, each piece's start is
+ * moved forward to the next byte that no token can run through (whitespace, a
+ * parenthesis, and so on), where the guess is always right.
+ * 
+ * The source is lexed twice: once to count each piece's tokens, so the stream
+ * can be allocated from the arena at its exact size, and once to fill it in.
+ * 
+ * @param   context The context whose arena the stream is allocated from.
+ * @param   source  A pointer to the source code to lex.
+ * @param   source_length   How long the entire source code string is.
+ * @param   thread_count    How many threads to use at most.
+ * @param   stream  The stream to fill. Should be zero initialized.
+ * @return  The number of tokens in the stream (or zero if out of memory).
+ */
+size_t
+plt_tokenize_parallel(
+    plt_context* context,
+    const char* source,
+    const size_t source_length,
+    int thread_count,
+    plt_token_stream* stream)
+{
+    if (thread_count > PILOT_MAX_THREADS)
+        thread_count = PILOT_MAX_THREADS;
+
+    if ((size_t)thread_count > source_length / PILOT_MIN_PARALLEL_CHUNK)
+        thread_count = (int)(source_length / PILOT_MIN_PARALLEL_CHUNK);
+
+    if (thread_count < 2)
+        return plt_tokenize(context, source, source_length, stream);
+
+    plt_lex_range ranges[PILOT_MAX_THREADS];
+    size_t begin = 0;
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        size_t end = source_length;
+
+        if (i < thread_count - 1)
+        {
+            end = find_token_boundary(
+                source,
+                source_length / thread_count * (i + 1),
+                source_length);
+
+            // A long token may have pushed an earlier range past this one.
+            if (end < begin)
+                end = begin;
+        }
+
+        ranges[i].source = source;
+        ranges[i].begin = begin;
+        ranges[i].end = end;
+        ranges[i].types = 0;
+        ranges[i].offsets = 0;
+        ranges[i].lengths = 0;
+        ranges[i].count = 0;
+
+        begin = end;
+    }
+
+    // First pass: count.
+    tokenize_ranges(ranges, thread_count);
+
+    size_t count = 0;
+    for (int i = 0; i < thread_count; i++)
+        count += ranges[i].count;
+
+    // Leave room for the EOF token.
+    if (!grow_token_stream(context, stream, count + 1))
+        return 0;
+
+    // Second pass: fill.
+    count = 0;
+    for (int i = 0; i < thread_count; i++)
+    {
+        ranges[i].types = stream->types + count;
+        ranges[i].offsets = stream->offsets + count;
+        ranges[i].lengths = stream->lengths + count;
+
+        count += ranges[i].count;
+    }
+
+    tokenize_ranges(ranges, thread_count);
+
+    stream->types[count] = PLT_TOKEN_EOF;
+    stream->offsets[count] = source_length;
+    stream->lengths[count] = 0;
+    stream->count = count + 1;
+
+    return stream->count;
+}
+
+#endif // PILOT_ENABLE_THREADS
+
+/// FILE INPUT
+
+// Mapping files needs the operating system's headers, so consumers have to ask
+// for it by defining PILOT_ENABLE_FILE_MAPPING. On POSIX systems, make sure
+// _POSIX_C_SOURCE is at least 200112L before including any system header.
+#ifdef PILOT_ENABLE_FILE_MAPPING
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * A read-only view of a file's contents, backed by the page cache instead of
+ * a copy in the arena.
+ */
+typedef struct plt_mapped_file_s {
+    // The contents of the file. Not null terminated!
+    const char* data;
+    // How many bytes long the file is.
+    size_t length;
+} plt_mapped_file;
+
+/**
+ * Maps a file into memory for reading.
+ * 
+ * The mapping is marked for sequential access, so the operating system can
+ * read ahead of the lexer and drop pages behind it. Empty files map to an
+ * empty string.
+ * 
+ * @param   path    The path of the file to map.
+ * @param   file    Receives the mapped contents.
+ * @return  One if the file was mapped, or zero if it couldn't be.
+ */
+int
+plt_map_file(const char* path, plt_mapped_file* file)
+{
+    file->data = 0;
+    file->length = 0;
+
+    #if defined(_WIN32)
+
+    HANDLE handle = CreateFileA(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        0,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        0);
+
+    if (handle == INVALID_HANDLE_VALUE)
+        return 0;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)
+        || (unsigned long long)size.QuadPart > (size_t)-1)
+    {
+        CloseHandle(handle);
+        return 0;
+    }
+
+    if (size.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        file->data = "";
+        return 1;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, 0, PAGE_READONLY, 0, 0, 0);
+    CloseHandle(handle);
+
+    if (!mapping)
+        return 0;
+
+    // The view keeps the mapping alive, so we don't need its handle anymore.
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!view)
+        return 0;
+
+    file->data = view;
+    file->length = (size_t)size.QuadPart;
+
+    #else
+
+    const int descriptor = open(path, O_RDONLY);
+
+    if (descriptor < 0)
+        return 0;
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0
+        || (unsigned long long)status.st_size > (size_t)-1)
+    {
+        close(descriptor);
+        return 0;
+    }
+
+    if (status.st_size == 0)
+    {
+        close(descriptor);
+        file->data = "";
+        return 1;
+    }
+
+    void* view = mmap(
+        0,
+        (size_t)status.st_size,
+        PROT_READ,
+        MAP_PRIVATE,
+        descriptor,
+        0);
+
+    // The mapping keeps the file open, so we don't need the descriptor.
+    close(descriptor);
+
+    if (view == MAP_FAILED)
+        return 0;
+
+    posix_madvise(view, (size_t)status.st_size, POSIX_MADV_SEQUENTIAL);
+
+    file->data = view;
+    file->length = (size_t)status.st_size;
+
+    #endif
+
+    return 1;
+}
+
+/**
+ * Unmaps a file mapped with plt_map_file(). Any tokens lexed from it no longer
+ * point at anything.
+ * 
+ * @param   file    The mapped file.
+ */
+void
+plt_unmap_file(plt_mapped_file* file)
+{
+    if (file->length > 0)
+    {
+        #if defined(_WIN32)
+        UnmapViewOfFile(file->data);
+        #else
+        munmap((void*)file->data, file->length);
+        #endif
+    }
+
+    file->data = 0;
+    file->length = 0;
+}
+
+/**
+ * Maps a file and lexes it straight out of the mapping with plt_tokenize().
+ * 
+ * The token offsets point into the mapping, so keep the file mapped for as
+ * long as you need the tokens' text, then release it with plt_unmap_file().
+ * 
+ * @param   context The context whose arena the stream is allocated from.
+ * @param   path    The path of the file to lex.
+ * @param   file    Receives the mapped contents.
+ * @param   stream  The stream to fill. Should be zero initialized.
+ * @return  The number of tokens in the stream (or zero if the file couldn't be
+ *          mapped or we're out of memory, in which case nothing stays mapped).
+ */
+size_t
+plt_tokenize_file(
+    plt_context* context,
+    const char* path,
+    plt_mapped_file* file,
+    plt_token_stream* stream)
+{
+    if (!plt_map_file(path, file))
+        return 0;
+
+    const size_t count = plt_tokenize(context, file->data, file->length, stream);
+
+    if (!count)
+        plt_unmap_file(file);
+
+    return count;
+}
+
+#endif // PILOT_ENABLE_FILE_MAPPING
+
+/// VALUES
+
+/**
+ * A Scheme value, packed into a single machine word.
+ * 
+ * The low three bits are a tag. Fixnums, symbols, characters, booleans and the
+ * empty list live entirely in the word, so they never allocate. Pairs and
+ * boxed values (such as flonums) are pointers into the arena, with the tag
+ * borrowing the low bits their alignment leaves free.
+ * 
+ *      ...xx1  fixnum, shifted up one bit
+ *      ...010  symbol, its ID shifted up three bits
+ *      ...100  pair
+ *      ...110  character, boolean, empty list or unspecified
+ *      ...000  box, whose first word says what's in it
+ */
+typedef size_t plt_value;
+
+#define PLT_TAG_MASK ((plt_value)7)
+#define PLT_TAG_BOX ((plt_value)0)
+#define PLT_TAG_SYMBOL ((plt_value)2)
+#define PLT_TAG_PAIR ((plt_value)4)
+#define PLT_TAG_IMMEDIATE ((plt_value)6)
+
+// The immediates other than characters.
+#define PLT_EMPTY_LIST ((plt_value)0x06)
+#define PLT_FALSE ((plt_value)0x0E)
+#define PLT_TRUE ((plt_value)0x16)
+#define PLT_UNSPECIFIED ((plt_value)0x1E)
+
+// Characters keep their code point above this low byte.
+#define PLT_CHARACTER_TAG ((plt_value)0x26)
+
+// Pairs and boxes are allocated on this alignment, which leaves the tag bits
+// free on every target.
+#define PLT_VALUE_ALIGNMENT 8
+
+// The sign bit of a fixnum, once it's shifted down. Fixnums are one bit
+// narrower than a size_t.
+#define PLT_FIXNUM_SIGN ((size_t)1 << (8 * sizeof(size_t) - 2))
+#define PLT_FIXNUM_MAX ((long long)(PLT_FIXNUM_SIGN - 1))
+#define PLT_FIXNUM_MIN (-(long long)PLT_FIXNUM_SIGN)
+
+#define VALUE_TYPES \
+    _(FIXNUM) \
+    _(FLONUM) \
+    _(SYMBOL) \
+    _(PAIR) \
+    _(CHARACTER) \
+    _(BOOLEAN) \
+    _(EMPTY_LIST) \
+    _(UNSPECIFIED) \
+    _(PROCEDURE) \
+    _(PRIMITIVE)
+
+/**
+ * The types of Scheme value.
+ */
+enum plt_value_type {
+    #define _(T) PLT_VALUE_ ## T,
+    VALUE_TYPES
+    #undef _
+};
+
+/**
+ * Returns the string representation of the value type.
+ * 
+ * @param value_type    The type of the value.
+ * @return  A string representation of the value type.
+ */
+const char*
+plt_value_type_to_string(enum plt_value_type value_type)
+{
+    switch (value_type)
+    {
+        #define _(T) case PLT_VALUE_ ## T: return #T;
+        VALUE_TYPES
+        #undef _
+
+        default:
+            return "UNDEFINED";
+    }
+}
+
+/**
+ * The two halves of a pair. A list is a chain of pairs through their cdrs,
+ * ending in the empty list.
+ */
+typedef struct plt_pair_s {
+    plt_value car;
+    plt_value cdr;
+} plt_pair;
+
+/**
+ * A boxed flonum.
+ */
+typedef struct plt_flonum_box_s {
+    // Always PLT_VALUE_FLONUM, like the first word of every box.
+    size_t type;
+    double flonum;
+} plt_flonum_box;
+
+/**
+ * Works out what type a value is.
+ * 
+ * @param   value   The value.
+ * @return  Its type.
+ */
+enum plt_value_type
+plt_type_of(const plt_value value)
+{
+    if (value & 1)
+        return PLT_VALUE_FIXNUM;
+
+    switch (value & PLT_TAG_MASK)
+    {
+        case PLT_TAG_SYMBOL:
+            return PLT_VALUE_SYMBOL;
+
+        case PLT_TAG_PAIR:
+            return PLT_VALUE_PAIR;
+
+        case PLT_TAG_BOX:
+            return (enum plt_value_type)*(const size_t*)value;
+
+        default:
+            if ((value & 0xFF) == PLT_CHARACTER_TAG)
+                return PLT_VALUE_CHARACTER;
+
+            if (value == PLT_TRUE || value == PLT_FALSE)
+                return PLT_VALUE_BOOLEAN;
+
+            return value == PLT_EMPTY_LIST
+                ? PLT_VALUE_EMPTY_LIST
+                : PLT_VALUE_UNSPECIFIED;
+    }
+}
+
+/**
+ * Makes a fixnum.
+ * 
+ * @param   fixnum  The fixnum's value, between PLT_FIXNUM_MIN and
+ *                  PLT_FIXNUM_MAX.
+ * @return  The fixnum.
+ */
+plt_value
+plt_make_fixnum(const long long fixnum)
+{
+    return ((plt_value)fixnum << 1) | 1;
+}
+
+/**
+ * Reads a fixnum's value.
+ * 
+ * @param   value   A fixnum.
+ * @return  The fixnum's value.
+ */
+long long
+plt_fixnum_value(const plt_value value)
+{
+    // Sign extend from the fixnum's top bit, whatever the size of a size_t.
+    return (long long)((value >> 1) ^ PLT_FIXNUM_SIGN)
+        - (long long)PLT_FIXNUM_SIGN;
+}
+
+/**
+ * Makes a symbol.
+ * 
+ * @param   symbol  The symbol's ID in its symbol table.
+ * @return  The symbol.
+ */
+plt_value
+plt_make_symbol(const size_t symbol)
+{
+    return (symbol << 3) | PLT_TAG_SYMBOL;
+}
+
+/**
+ * Reads a symbol's ID.
+ * 
+ * @param   value   A symbol.
+ * @return  The symbol's ID in its symbol table.
+ */
+size_t
+plt_symbol_value(const plt_value value)
+{
+    return value >> 3;
+}
+
+/**
+ * Makes a character.
+ * 
+ * @param   code_point  The character's Unicode code point.
+ * @return  The character.
+ */
+plt_value
+plt_make_character(const unsigned int code_point)
+{
+    return ((plt_value)code_point << 8) | PLT_CHARACTER_TAG;
+}
+
+/**
+ * Reads a character's code point.
+ * 
+ * @param   value   A character.
+ * @return  The character's Unicode code point.
+ */
+unsigned int
+plt_character_value(const plt_value value)
+{
+    return (unsigned int)(value >> 8);
+}
+
+/**
+ * Makes a boolean.
+ * 
+ * @param   boolean Zero for false, anything else for true.
+ * @return  The boolean.
+ */
+plt_value
+plt_make_boolean(const int boolean)
+{
+    return boolean ? PLT_TRUE : PLT_FALSE;
+}
+
+/**
+ * Allocates a pair.
+ * 
+ * @param   context The context whose arena the pair lives in.
+ * @param   car The pair's first half.
+ * @param   cdr The pair's second half.
+ * @return  The pair (or the empty list if out of memory, which no pair can
+ *          be mistaken for).
+ */
+plt_value
+plt_cons(plt_context* context, const plt_value car, const plt_value cdr)
+{
+    plt_pair* pair = plt_allocate_headerless(
+        context,
+        sizeof(plt_pair),
+        PLT_VALUE_ALIGNMENT);
+
+    if (!pair)
+        return PLT_EMPTY_LIST;
+
+    pair->car = car;
+    pair->cdr = cdr;
+
+    return (plt_value)pair | PLT_TAG_PAIR;
+}
+
+/**
+ * Finds the two halves of a pair.
+ * 
+ * @param   value   A pair.
+ * @return  The pair's halves, which can be changed in place.
+ */
+plt_pair*
+plt_pair_of(const plt_value value)
+{
+    return (plt_pair*)(value - PLT_TAG_PAIR);
+}
+
+/**
+ * Reads the first half of a pair.
+ * 
+ * @param   value   A pair.
+ * @return  The pair's car.
+ */
+plt_value
+plt_car(const plt_value value)
+{
+    return plt_pair_of(value)->car;
+}
+
+/**
+ * Reads the second half of a pair.
+ * 
+ * @param   value   A pair.
+ * @return  The pair's cdr.
+ */
+plt_value
+plt_cdr(const plt_value value)
+{
+    return plt_pair_of(value)->cdr;
+}
+
+/**
+ * Boxes a flonum.
+ * 
+ * @param   context The context whose arena the box lives in.
+ * @param   flonum  The flonum's value.
+ * @return  The flonum (or the empty list if out of memory).
+ */
+plt_value
+plt_make_flonum(plt_context* context, const double flonum)
+{
+    plt_flonum_box* box = plt_allocate_headerless(
+        context,
+        sizeof(plt_flonum_box),
+        PLT_VALUE_ALIGNMENT);
+
+    if (!box)
+        return PLT_EMPTY_LIST;
+
+    box->type = PLT_VALUE_FLONUM;
+    box->flonum = flonum;
+
+    return (plt_value)box;
+}
+
+/**
+ * Reads a flonum's value.
+ * 
+ * @param   value   A flonum.
+ * @return  The flonum's value.
+ */
+double
+plt_flonum_value(const plt_value value)
+{
+    return ((const plt_flonum_box*)value)->flonum;
+}
+
+/// READING
+
+/**
+ * A list (or quote) the reader is partway through.
+ */
+typedef struct plt_reader_frame_s {
+    // The list's first pair, or the empty list while the list is empty.
+    plt_value head;
+    // The list's last pair, which the next item is appended to.
+    plt_value tail;
+    // Whether this is a list, or a quote waiting for its datum.
+    unsigned char is_quote;
+    // Whether the list has seen a dot, and whether its final cdr came after.
+    unsigned char dot;
+} plt_reader_frame;
+
+/**
+ * Stores Pilot Scheme's reader state for a source string.
+ * 
+ * Nested lists are kept on the reader's own stack rather than the C stack, so
+ * no amount of nesting can overflow it. Zero initialize the reader, then give
+ * it a symbol table before reading.
+ */
+typedef struct plt_reader_s {
+    // The lexer the reader takes its tokens from.
+    plt_lexer lexer;
+    // Where symbols are interned.
+    plt_symbol_table* symbols;
+    // The lists (and quotes) the reader is partway through, innermost last.
+    plt_reader_frame* frames;
+    // How many frames the stack has room for.
+    size_t frame_capacity;
+} plt_reader;
+
+/**
+ * The outcome of reading a form.
+ */
+typedef struct plt_read_result_s {
+    #define READ_STATUSES \
+        _(OK) \
+        _(EOF) \
+        _(UNEXPECTED_LIST_END) \
+        _(UNTERMINATED_LIST) \
+        _(MISPLACED_DOT) \
+        _(UNKNOWN_TOKEN) \
+        _(OUT_OF_MEMORY)
+
+    // Whether a form was read, and if not, why not.
+    enum plt_read_status {
+        #define _(S) PLT_READ_ ## S,
+        READ_STATUSES
+        #undef _
+    } status;
+
+    // The form that was read.
+    plt_value form;
+    // Where the form starts in the source, or where the reader gave up.
+    size_t offset;
+    // How many bytes of the arena reading the form took, symbols and the
+    // reader's stack included.
+    size_t allocated_length;
+} plt_read_result;
+
+/**
+ * Returns the string representation of the read status.
+ * 
+ * @param read_status   The read status.
+ * @return  A string representation of the read status.
+ */
+const char*
+plt_read_status_to_string(enum plt_read_status read_status)
+{
+    switch (read_status)
+    {
+        #define _(S) case PLT_READ_ ## S: return #S;
+        READ_STATUSES
+        #undef _
+
+        default:
+            return "UNDEFINED";
+    }
+}
+
+/**
+ * Makes room for another frame on the reader's stack.
+ * 
+ * @param   context The context whose arena the stack grows in.
+ * @param   reader  The reader.
+ * @param   depth   How many frames are on the stack.
+ * @return  One if there's room, or zero if we're out of memory.
+ */
+static int
+reserve_reader_frame(
+    plt_context* context,
+    plt_reader* reader,
+    const size_t depth)
+{
+    if (depth < reader->frame_capacity)
+        return 1;
+
+    const size_t capacity =
+        reader->frame_capacity ? 2 * reader->frame_capacity : 16;
+
+    plt_reader_frame* frames = reallocate(
+        context,
+        reader->frames,
+        capacity * sizeof(*reader->frames));
+
+    if (!frames)
+        return 0;
+
+    reader->frames = frames;
+    reader->frame_capacity = capacity;
+
+    return 1;
+}
+
+/**
+ * Works out which boolean the name after a # spells.
+ * 
+ * @param   name    The name, without its #.
+ * @param   length  How many bytes the name is.
+ * @return  PLT_TRUE or PLT_FALSE, or PLT_UNSPECIFIED if the name isn't t, f,
+ *          true or false.
+ */
+static plt_value
+boolean_named(const char* name, const size_t length)
+{
+    static const char* const spellings[] = { "t", "true", "f", "false" };
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        size_t j = 0;
+
+        while (j < length && spellings[i][j] == name[j])
+            j++;
+
+        if (j == length && !spellings[i][j])
+            return i < 2 ? PLT_TRUE : PLT_FALSE;
+    }
+
+    return PLT_UNSPECIFIED;
+}
+
+/**
+ * Reads the next form from the source code provided.
+ * 
+ * Lists become chains of pairs, 'x becomes (quote x), (a . b) becomes a single
+ * pair, identifiers become symbols, numbers become fixnums or flonums and #t,
+ * #f, #true and #false become booleans.
+ * Pairs and flonums are allocated from the arena, and symbols are interned in
+ * the reader's symbol table. Numbers too big for a fixnum become flonums.
+ * 
+ * Call this repeatedly to read every form in the source, until it returns
+ * PLT_READ_EOF. After an error, reading picks up after the offending token.
+ * 
+ * @param   context The context whose arena the forms are allocated from.
+ * @param   reader  A pointer to the current reader.
+ * @param   source  A pointer to the source code we are currently reading.
+ * @param   source_length   How long the entire source code string is.
+ * @return  The form, or why there isn't one.
+ */
+plt_read_result
+plt_read(
+    plt_context* context,
+    plt_reader* reader,
+    const char* source,
+    const size_t source_length)
+{
+    const size_t used_length = context->stats.used_length;
+
+    plt_read_result result;
+    result.status = PLT_READ_OK;
+    result.form = PLT_EMPTY_LIST;
+    result.offset = reader->lexer.cursor_offset;
+    result.allocated_length = 0;
+
+    size_t depth = 0;
+
+    for (;;)
+    {
+        // Numbers are worked out from the digits the lexer gathers as it
+        // goes, without going back over their text.
+        reader->lexer.digits = (plt_number_digits){ 0 };
+
+        const plt_token_slice slice = next_token_slice(
+            &reader->lexer,
+            source,
+            source_length,
+            &reader->lexer.digits);
+
+        if (depth == 0)
+            result.offset = slice.offset;
+
+        plt_reader_frame* frame = depth ? &reader->frames[depth - 1] : 0;
+        plt_value datum = PLT_EMPTY_LIST;
+
+        switch (slice.type)
+        {
+            case PLT_TOKEN_LIST_START:
+            case PLT_TOKEN_QUOTE:
+                if (!reserve_reader_frame(context, reader, depth))
+                {
+                    result.status = PLT_READ_OUT_OF_MEMORY;
+                    break;
+                }
+
+                frame = &reader->frames[depth++];
+                frame->head = PLT_EMPTY_LIST;
+                frame->tail = PLT_EMPTY_LIST;
+                frame->is_quote = slice.type == PLT_TOKEN_QUOTE;
+                frame->dot = 0;
+
+                continue;
+
+            case PLT_TOKEN_LIST_END:
+                if (!frame || frame->is_quote)
+                    result.status = PLT_READ_UNEXPECTED_LIST_END;
+                else if (frame->dot == 1)
+                    result.status = PLT_READ_MISPLACED_DOT;
+                else
+                {
+                    datum = frame->head;
+                    depth--;
+                }
+
+                break;
+
+            case PLT_TOKEN_NUMBER:
+            {
+                const plt_number number = number_from_digits(
+                    &reader->lexer.digits,
+                    source + slice.offset,
+                    slice.length);
+
+                // A fixnum can go one further below zero than above it.
+                const size_t fixnum_limit = number.is_negative
+                    ? (size_t)PLT_FIXNUM_SIGN
+                    : (size_t)PLT_FIXNUM_MAX;
+
+                if (!number.is_flonum && number.fixnum <= fixnum_limit)
+                    datum = plt_make_fixnum(number.is_negative
+                        ? -(long long)number.fixnum
+                        : (long long)number.fixnum);
+                else
+                {
+                    const double flonum = number.is_flonum
+                        ? number.flonum
+                        : (double)number.fixnum;
+
+                    datum = plt_make_flonum(
+                        context,
+                        number.is_negative && !number.is_flonum
+                            ? -flonum
+                            : flonum);
+
+                    if (datum == PLT_EMPTY_LIST)
+                        result.status = PLT_READ_OUT_OF_MEMORY;
+                }
+
+                break;
+            }
+
+            case PLT_TOKEN_IDENT:
+            {
+                // A lone dot in a list means its final cdr comes next.
+                if (slice.length == 1
+                    && source[slice.offset] == '.'
+                    && frame
+                    && !frame->is_quote)
+                {
+                    if (frame->head == PLT_EMPTY_LIST || frame->dot)
+                    {
+                        result.status = PLT_READ_MISPLACED_DOT;
+                        break;
+                    }
+
+                    frame->dot = 1;
+
+                    continue;
+                }
+
+                const size_t symbol = plt_intern(
+                    context,
+                    reader->symbols,
+                    source + slice.offset,
+                    slice.length);
+
+                if (symbol == PLT_NO_SYMBOL)
+                    result.status = PLT_READ_OUT_OF_MEMORY;
+                else
+                    datum = plt_make_symbol(symbol);
+
+                break;
+            }
+
+            case PLT_TOKEN_BOOLEAN:
+                datum = boolean_named(
+                    source + slice.offset + 1,
+                    slice.length - 1);
+
+                if (datum == PLT_UNSPECIFIED)
+                    result.status = PLT_READ_UNKNOWN_TOKEN;
+
+                break;
+
+            case PLT_TOKEN_EOF:
+                result.status =
+                    depth ? PLT_READ_UNTERMINATED_LIST : PLT_READ_EOF;
+                break;
+
+            default:
+                result.status = PLT_READ_UNKNOWN_TOKEN;
+                break;
+        }
+
+        // Hand the datum to the lists and quotes waiting on it, innermost
+        // first, until one of them still needs more.
+        while (result.status == PLT_READ_OK && depth)
+        {
+            frame = &reader->frames[depth - 1];
+
+            if (frame->is_quote)
+            {
+                const size_t quote =
+                    plt_intern(context, reader->symbols, "quote", 5);
+                const plt_value quoted =
+                    plt_cons(context, datum, PLT_EMPTY_LIST);
+
+                datum = quote != PLT_NO_SYMBOL && quoted != PLT_EMPTY_LIST
+                    ? plt_cons(context, plt_make_symbol(quote), quoted)
+                    : PLT_EMPTY_LIST;
+
+                if (datum == PLT_EMPTY_LIST)
+                {
+                    result.status = PLT_READ_OUT_OF_MEMORY;
+                    break;
+                }
+
+                depth--;
+
+                continue;
+            }
+
+            if (frame->dot == 2)
+            {
+                result.status = PLT_READ_MISPLACED_DOT;
+                break;
+            }
+
+            if (frame->dot == 1)
+            {
+                plt_pair_of(frame->tail)->cdr = datum;
+                frame->dot = 2;
+                break;
+            }
+
+            const plt_value pair = plt_cons(context, datum, PLT_EMPTY_LIST);
+
+            if (pair == PLT_EMPTY_LIST)
+            {
+                result.status = PLT_READ_OUT_OF_MEMORY;
+                break;
+            }
+
+            if (frame->tail != PLT_EMPTY_LIST)
+                plt_pair_of(frame->tail)->cdr = pair;
+            else
+                frame->head = pair;
+
+            frame->tail = pair;
+            break;
+        }
+
+        if (result.status != PLT_READ_OK)
+        {
+            if (result.status != PLT_READ_EOF)
+                result.offset = slice.offset;
+
+            break;
+        }
+
+        if (!depth)
+        {
+            result.form = datum;
+            break;
+        }
+    }
+
+    result.allocated_length = context->stats.used_length - used_length;
+
+    return result;
+}
+
+/// EVALUATION
+
+// Unbound globals hold this immediate, which no Scheme code can get hold of.
+#define PLT_UNBOUND ((plt_value)0x2E)
+
+/**
+ * The instructions of the virtual machine. Each one is a word of bytecode,
+ * followed by its operand, if it has one.
+ */
+#define OPCODES \
+    /* Pushes the constant with the given index. */ \
+    _(CONSTANT) \
+    /* Pushes the local variable in the given slot of the running call. */ \
+    _(LOCAL) \
+    /* Sets the local variable in the given slot to the value on top. */ \
+    _(SET_LOCAL) \
+    /* Pushes the value in the given cell of the running closure. */ \
+    _(FREE) \
+    /* Pushes the contents of the boxed local variable in the given slot. */ \
+    _(LOCAL_CELL) \
+    /* Sets the boxed local variable in the given slot to the value on top. */ \
+    _(SET_LOCAL_CELL) \
+    /* Pushes the contents of the boxed captured variable in the given cell */ \
+    /* of the running closure. */ \
+    _(FREE_CELL) \
+    /* Sets the boxed captured variable in the given cell of the running */ \
+    /* closure to the value on top. */ \
+    _(SET_FREE_CELL) \
+    /* Pushes the global with the given symbol ID. */ \
+    _(GLOBAL) \
+    /* Sets the global with the given symbol ID to the value on top. */ \
+    _(SET_GLOBAL) \
+    /* Pops the value on top into the given slot of the running call. */ \
+    _(BIND) \
+    /* Moves the value in the given slot into a box of its own, so that */ \
+    /* closures can share it. */ \
+    _(BOX) \
+    /* Defines the global with the given symbol ID as the value on top. */ \
+    _(DEFINE) \
+    /* Throws away the value on top. */ \
+    _(POP) \
+    /* Carries on from the given offset in the code. */ \
+    _(JUMP) \
+    /* Pops the value on top, and jumps to the given offset if it's false. */ \
+    _(JUMP_IF_FALSE) \
+    /* Pushes a closure over the child prototype with the given index. */ \
+    _(CLOSURE) \
+    /* Stores the closure on top in its own cell with the given index, for */ \
+    /* a procedure that refers to itself. */ \
+    _(SELF) \
+    /* Calls the procedure under the given number of arguments. */ \
+    _(CALL) \
+    /* Calls the procedure under the given number of arguments in place of */ \
+    /* the running one, which returns whatever the callee does. */ \
+    _(TAIL_CALL) \
+    /* Returns the value on top to the caller. */ \
+    _(RETURN)
+
+enum plt_opcode {
+    #define _(O) PLT_OP_ ## O,
+    OPCODES
+    #undef _
+};
+
+/**
+ * The outcome of evaluating a form.
+ */
+typedef struct plt_eval_result_s {
+    #define EVAL_STATUSES \
+        _(OK) \
+        _(SYNTAX_ERROR) \
+        _(UNBOUND_VARIABLE) \
+        _(NOT_A_PROCEDURE) \
+        _(WRONG_ARGUMENT_COUNT) \
+        _(WRONG_TYPE) \
+        _(DIVIDE_BY_ZERO) \
+        _(STACK_OVERFLOW) \
+        _(OUT_OF_MEMORY)
+
+    // Whether the form was evaluated, and if not, why not.
+    enum plt_eval_status {
+        #define _(S) PLT_EVAL_ ## S,
+        EVAL_STATUSES
+        #undef _
+    } status;
+
+    // The form's value, or the value that caused the error.
+    plt_value value;
+} plt_eval_result;
+
+/**
+ * Returns the string representation of the eval status.
+ * 
+ * @param eval_status   The eval status.
+ * @return  A string representation of the eval status.
+ */
+const char*
+plt_eval_status_to_string(enum plt_eval_status eval_status)
+{
+    switch (eval_status)
+    {
+        #define _(S) case PLT_EVAL_ ## S: return #S;
+        EVAL_STATUSES
+        #undef _
+
+        default:
+            return "UNDEFINED";
+    }
+}
+
+/**
+ * A compiled lambda (or top level form): its bytecode, and everything the
+ * bytecode refers to.
+ */
+typedef struct plt_prototype_s {
+    // The bytecode.
+    unsigned int* code;
+    // How many words of bytecode there are.
+    size_t code_length;
+    // How many words of bytecode there's room for.
+    size_t code_capacity;
+    // The values CONSTANT pushes.
+    plt_value* constants;
+    // How many constants there are.
+    size_t constant_count;
+    // How many constants there's room for.
+    size_t constant_capacity;
+    // The lambdas CLOSURE closes over.
+    struct plt_prototype_s** children;
+    // How many children there are.
+    size_t child_count;
+    // How many children there's room for.
+    size_t child_capacity;
+    // Where each of the closure's cells is copied from when it's created:
+    // a pair of words, PLT_CAPTURE_LOCAL or PLT_CAPTURE_FREE, then the slot
+    // or cell of the enclosing procedure.
+    unsigned int* captures;
+    // How many cells a closure over the prototype has.
+    size_t capture_count;
+    // How many parameters there are.
+    size_t parameter_count;
+    // How many local variables a call has on the stack: the parameters, then
+    // the variables of every let in the body.
+    size_t frame_size;
+    // The most values the bytecode ever has on the stack at once, on top of
+    // the local variables.
+    size_t max_stack_depth;
+    // Where what a call to the prototype allocates goes: PLT_REGION_CALLER or
+    // PLT_REGION_LOCAL.
+    size_t region;
+} plt_prototype;
+
+// A call's allocations belong to its caller's region...
+#define PLT_REGION_CALLER 0
+// ...or to a region of its own, which is freed when it returns.
+#define PLT_REGION_LOCAL 1
+
+// Closure cells are copied from a local variable of the enclosing procedure...
+#define PLT_CAPTURE_LOCAL 0
+// ...or from one of its own cells.
+#define PLT_CAPTURE_FREE 1
+
+/**
+ * A boxed closure: a prototype, and a copy of each free variable it refers to.
+ * 
+ * Closures are flat. They hold the values they need, rather than the variables
+ * of every enclosing call. Variables that are both captured and assigned are
+ * boxed, and closures share the box.
+ */
+typedef struct plt_procedure_box_s {
+    // Always PLT_VALUE_PROCEDURE, like the first word of every box.
+    size_t type;
+    const plt_prototype* prototype;
+    // The captured values, as the prototype's captures lists them.
+    plt_value cells[];
+} plt_procedure_box;
+
+struct plt_vm_s;
+
+/**
+ * A procedure implemented in C.
+ * 
+ * Primitives report errors with plt_raise(). A primitive that keeps hold of a
+ * value past the call has to tell the virtual machine with plt_note_escape().
+ * 
+ * @param   vm  The virtual machine calling the primitive.
+ * @param   arguments   The arguments.
+ * @param   argument_count  How many arguments there are.
+ * @return  The primitive's result.
+ */
+typedef plt_value (*plt_primitive)(
+    struct plt_vm_s* vm,
+    const plt_value* arguments,
+    size_t argument_count);
+
+/**
+ * What a primitive allocates, which the compiler takes into account when it
+ * infers the region of a procedure that calls it.
+ */
+enum plt_primitive_allocation {
+    // Nothing.
+    PLT_PRIMITIVE_PURE,
+    // Sometimes, but not its result as a rule: arithmetic that overflows into
+    // flonums, for example.
+    PLT_PRIMITIVE_ALLOCATES,
+    // Its result, every time, like cons.
+    PLT_PRIMITIVE_CONSTRUCTS
+};
+
+/**
+ * A boxed primitive.
+ */
+typedef struct plt_primitive_box_s {
+    // Always PLT_VALUE_PRIMITIVE, like the first word of every box.
+    size_t type;
+    plt_primitive function;
+    // How many arguments the primitive takes, or -1 for any number.
+    int arity;
+    // What the primitive allocates.
+    enum plt_primitive_allocation allocation;
+} plt_primitive_box;
+
+/**
+ * Where a procedure call returns to.
+ */
+typedef struct plt_call_frame_s {
+    // The caller's prototype.
+    const plt_prototype* prototype;
+    // The instruction after the call.
+    const unsigned int* return_address;
+    // Where the caller's own callee sits on the value stack, followed by its
+    // local variables.
+    plt_value* base;
+    // Whether the call has a region of its own, to free when it returns.
+    size_t has_region;
+    // Where the call's region begins in the arena.
+    plt_arena_mark region;
+    // Where the part of the region that the call's next tail call can free
+    // begins: whatever was allocated since its latest tail call.
+    plt_arena_mark tail_region;
+} plt_call_frame;
+
+/**
+ * Stores everything Pilot Scheme needs to evaluate code.
+ * 
+ * Everything the virtual machine allocates, compiled code included, comes out
+ * of its context's arena.
+ */
+typedef struct plt_vm_s {
+    // The context the virtual machine allocates from.
+    plt_context* context;
+    // Where symbols are interned. Must be the reader's symbol table.
+    plt_symbol_table* symbols;
+    // The value of every global, indexed by symbol ID.
+    plt_value* globals;
+    // How many globals there's room for.
+    size_t global_capacity;
+    // The value stack.
+    plt_value* stack;
+    // How many values the stack holds.
+    size_t stack_size;
+    // The procedure calls that haven't returned yet.
+    plt_call_frame* frames;
+    // How many call frames there's room for.
+    size_t frame_capacity;
+    // The symbol IDs of the special forms.
+    size_t quote_symbol;
+    size_t if_symbol;
+    size_t define_symbol;
+    size_t set_symbol;
+    size_t lambda_symbol;
+    size_t begin_symbol;
+    size_t let_symbol;
+    // The highest address of the arena that something outside of the running
+    // calls' regions has been made to point to. Regions above it are free to
+    // go.
+    size_t escape_ceiling;
+    // Why the last primitive failed, if it did.
+    enum plt_eval_status status;
+    // The value that made it fail.
+    plt_value error_value;
+} plt_vm;
+
+/**
+ * Reports an error from a primitive.
+ * 
+ * @param   vm  The virtual machine running the primitive.
+ * @param   status  What went wrong.
+ * @param   value   The value that caused it.
+ * @return  A value for the primitive to return, which is thrown away.
+ */
+plt_value
+plt_raise(plt_vm* vm, const enum plt_eval_status status, const plt_value value)
+{
+    vm->status = status;
+    vm->error_value = value;
+
+    return PLT_UNSPECIFIED;
+}
+
+/**
+ * Makes room for a global in the virtual machine.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   symbol  The global's symbol ID.
+ * @return  One if there's room, or zero if we're out of memory.
+ */
+static int
+reserve_global(plt_vm* vm, const size_t symbol)
+{
+    if (symbol < vm->global_capacity)
+        return 1;
+
+    size_t capacity = vm->global_capacity ? vm->global_capacity : 64;
+
+    while (capacity <= symbol)
+        capacity *= 2;
+
+    plt_value* globals = reallocate(
+        vm->context,
+        vm->globals,
+        capacity * sizeof(*vm->globals));
+
+    if (!globals)
+        return 0;
+
+    for (size_t i = vm->global_capacity; i < capacity; i++)
+        globals[i] = PLT_UNBOUND;
+
+    vm->globals = globals;
+    vm->global_capacity = capacity;
+
+    return 1;
+}
+
+/// COMPILING
+
+/**
+ * A variable in scope while compiling, either a local or one of a closure's
+ * cells.
+ */
+typedef struct plt_scope_variable_s {
+    // The variable's symbol ID.
+    size_t symbol;
+    // Whether the variable holds a box with its value in, rather than the
+    // value itself.
+    size_t is_boxed;
+} plt_scope_variable;
+
+/**
+ * The state of compiling one prototype.
+ */
+typedef struct plt_compiler_s {
+    // The virtual machine the code is for.
+    plt_vm* vm;
+    // The compiler of the enclosing lambda, or zero for a top level form.
+    struct plt_compiler_s* parent;
+    // The prototype being compiled.
+    plt_prototype* prototype;
+    // The variables given slots so far, by slot. Those that have gone out of
+    // scope have no symbol.
+    plt_scope_variable* locals;
+    // How many slots have been given out.
+    size_t local_count;
+    // How many variables there's room for.
+    size_t local_capacity;
+    // The variables of enclosing lambdas that the code refers to, by cell.
+    plt_scope_variable* free_variables;
+    // How many there's room for, in this and in the prototype's captures.
+    size_t free_variable_capacity;
+    // How many values the code compiled so far leaves on the stack.
+    size_t stack_depth;
+    // Whether the code allocates, or calls something that might.
+    int allocates;
+    // Whether the code might return something it allocated.
+    int returns_fresh;
+    // Whether the code stores values outside of the call, in globals or in
+    // boxes it captured.
+    int stores_outside;
+    // Why compiling failed, if it did.
+    enum plt_eval_status status;
+    // The form that made it fail.
+    plt_value error_value;
+} plt_compiler;
+
+/**
+ * Records why compiling failed.
+ * 
+ * @param   compiler    The compiler.
+ * @param   status  What went wrong.
+ * @param   form    The form that caused it.
+ * @return  Zero, for the compiling function to return.
+ */
+static int
+compile_error(
+    plt_compiler* compiler,
+    const enum plt_eval_status status,
+    const plt_value form)
+{
+    compiler->status = status;
+    compiler->error_value = form;
+
+    return 0;
+}
+
+/**
+ * Appends a word of bytecode to the prototype, and keeps track of how deep the
+ * stack gets.
+ * 
+ * @param   compiler    The compiler.
+ * @param   word    The opcode or operand.
+ * @param   stack_effect    How many values the instruction pushes (or, if
+ *                          negative, pops). Zero for operands.
+ * @return  One if the word was appended, or zero if we're out of memory.
+ */
+static int
+emit(plt_compiler* compiler, const size_t word, const int stack_effect)
+{
+    plt_prototype* prototype = compiler->prototype;
+
+    if (prototype->code_length == prototype->code_capacity)
+    {
+        const size_t capacity =
+            prototype->code_capacity ? 2 * prototype->code_capacity : 32;
+
+        unsigned int* code = reallocate(
+            compiler->vm->context,
+            prototype->code,
+            capacity * sizeof(*prototype->code));
+
+        if (!code)
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        prototype->code = code;
+        prototype->code_capacity = capacity;
+    }
+
+    prototype->code[prototype->code_length++] = (unsigned int)word;
+
+    compiler->stack_depth += stack_effect;
+
+    if (compiler->stack_depth > prototype->max_stack_depth)
+        prototype->max_stack_depth = compiler->stack_depth;
+
+    return 1;
+}
+
+/**
+ * Appends an instruction with an operand.
+ * 
+ * @param   compiler    The compiler.
+ * @param   opcode  The instruction.
+ * @param   operand The operand.
+ * @param   stack_effect    How many values the instruction pushes (or, if
+ *                          negative, pops).
+ * @return  One if the instruction was appended, or zero if we're out of memory.
+ */
+static int
+emit_with_operand(
+    plt_compiler* compiler,
+    const enum plt_opcode opcode,
+    const size_t operand,
+    const int stack_effect)
+{
+    // Keep track of what the code does, to infer its region from.
+    switch (opcode)
+    {
+        case PLT_OP_BOX:
+        case PLT_OP_CLOSURE:
+            compiler->allocates = 1;
+            break;
+
+        case PLT_OP_SET_GLOBAL:
+        case PLT_OP_SET_FREE_CELL:
+        case PLT_OP_DEFINE:
+            compiler->stores_outside = 1;
+            break;
+
+        default:
+            break;
+    }
+
+    return emit(compiler, opcode, stack_effect) && emit(compiler, operand, 0);
+}
+
+/**
+ * Appends an instruction that pushes a constant.
+ * 
+ * @param   compiler    The compiler.
+ * @param   constant    The constant.
+ * @return  One if the instruction was appended, or zero if we're out of memory.
+ */
+static int
+emit_constant(plt_compiler* compiler, const plt_value constant)
+{
+    plt_prototype* prototype = compiler->prototype;
+
+    if (prototype->constant_count == prototype->constant_capacity)
+    {
+        const size_t capacity =
+            prototype->constant_capacity ? 2 * prototype->constant_capacity : 8;
+
+        plt_value* constants = reallocate(
+            compiler->vm->context,
+            prototype->constants,
+            capacity * sizeof(*prototype->constants));
+
+        if (!constants)
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        prototype->constants = constants;
+        prototype->constant_capacity = capacity;
+    }
+
+    prototype->constants[prototype->constant_count] = constant;
+
+    return emit_with_operand(
+        compiler,
+        PLT_OP_CONSTANT,
+        prototype->constant_count++,
+        1);
+}
+
+/**
+ * Counts the items of a proper list.
+ * 
+ * @param   list    The list.
+ * @return  How many items it has, or -1 if it isn't a proper list.
+ */
+static long
+list_length(plt_value list)
+{
+    long length = 0;
+
+    for (; list != PLT_EMPTY_LIST; list = plt_cdr(list), length++)
+        if ((list & PLT_TAG_MASK) != PLT_TAG_PAIR)
+            return -1;
+
+    return length;
+}
+
+// Flags from scan_variable().
+#define PLT_VARIABLE_ASSIGNED 1
+#define PLT_VARIABLE_CAPTURED 2
+
+/**
+ * Finds out whether a variable might be assigned, and whether it might be
+ * referred to from a nested lambda, by looking for its name in the code it's
+ * in scope for.
+ * 
+ * Inner bindings of the same name aren't told apart, and nor is quoted data,
+ * so the answer errs on the side of yes.
+ * 
+ * @param   vm  The virtual machine the code is for.
+ * @param   form    The code.
+ * @param   symbol  The variable's symbol ID.
+ * @param   is_nested   Whether the code is inside a nested lambda.
+ * @return  PLT_VARIABLE_ASSIGNED and PLT_VARIABLE_CAPTURED, if they apply.
+ */
+static int
+scan_variable(
+    const plt_vm* vm,
+    const plt_value form,
+    const size_t symbol,
+    int is_nested)
+{
+    if (form == plt_make_symbol(symbol))
+        return is_nested ? PLT_VARIABLE_CAPTURED : 0;
+
+    if ((form & PLT_TAG_MASK) != PLT_TAG_PAIR)
+        return 0;
+
+    const plt_value head = plt_car(form);
+    int flags = 0;
+
+    // Named lets are lambdas too.
+    if (head == plt_make_symbol(vm->lambda_symbol)
+        || (head == plt_make_symbol(vm->let_symbol)
+            && (plt_cdr(form) & PLT_TAG_MASK) == PLT_TAG_PAIR
+            && (plt_car(plt_cdr(form)) & PLT_TAG_MASK) == PLT_TAG_SYMBOL))
+        is_nested = 1;
+
+    if (head == plt_make_symbol(vm->set_symbol)
+        && (plt_cdr(form) & PLT_TAG_MASK) == PLT_TAG_PAIR
+        && plt_car(plt_cdr(form)) == plt_make_symbol(symbol))
+        flags |= PLT_VARIABLE_ASSIGNED;
+
+    // Recurse into each item, but loop along the list.
+    plt_value item = form;
+
+    for (; (item & PLT_TAG_MASK) == PLT_TAG_PAIR; item = plt_cdr(item))
+    {
+        flags |= scan_variable(vm, plt_car(item), symbol, is_nested);
+
+        if (flags == (PLT_VARIABLE_ASSIGNED | PLT_VARIABLE_CAPTURED))
+            return flags;
+    }
+
+    return flags | scan_variable(vm, item, symbol, is_nested);
+}
+
+/**
+ * Works out whether a variable needs a box: closures copy the values they
+ * capture, so a variable that's captured and also assigned has to live in a
+ * box they can share.
+ * 
+ * @param   vm  The virtual machine the code is for.
+ * @param   scope   The code the variable is in scope for.
+ * @param   symbol  The variable's symbol ID.
+ * @return  One if the variable needs a box, otherwise zero.
+ */
+static size_t
+needs_box(const plt_vm* vm, const plt_value scope, const size_t symbol)
+{
+    return scan_variable(vm, scope, symbol, 0)
+        == (PLT_VARIABLE_ASSIGNED | PLT_VARIABLE_CAPTURED);
+}
+
+/**
+ * Gives the closure being compiled a cell for a variable of an enclosing
+ * lambda.
+ * 
+ * @param   compiler    The compiler.
+ * @param   variable    The variable.
+ * @param   from    Where the cell is copied from in the enclosing procedure:
+ *                  PLT_CAPTURE_LOCAL or PLT_CAPTURE_FREE.
+ * @param   index   The slot or cell it's copied from.
+ * @return  One if there's a cell for the variable, or zero if out of memory.
+ */
+static int
+add_free_variable(
+    plt_compiler* compiler,
+    const plt_scope_variable variable,
+    const unsigned int from,
+    const size_t index)
+{
+    plt_prototype* prototype = compiler->prototype;
+
+    if (prototype->capture_count == compiler->free_variable_capacity)
+    {
+        const size_t capacity = compiler->free_variable_capacity
+            ? 2 * compiler->free_variable_capacity
+            : 4;
+
+        plt_scope_variable* free_variables = reallocate(
+            compiler->vm->context,
+            compiler->free_variables,
+            capacity * sizeof(*compiler->free_variables));
+        unsigned int* captures = reallocate(
+            compiler->vm->context,
+            prototype->captures,
+            2 * capacity * sizeof(*prototype->captures));
+
+        if (!free_variables || !captures)
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        compiler->free_variables = free_variables;
+        compiler->free_variable_capacity = capacity;
+        prototype->captures = captures;
+    }
+
+    compiler->free_variables[prototype->capture_count] = variable;
+    prototype->captures[2 * prototype->capture_count] = from;
+    prototype->captures[2 * prototype->capture_count + 1] = (unsigned int)index;
+    prototype->capture_count++;
+
+    return 1;
+}
+
+/**
+ * Finds where a variable lives, as seen from the code being compiled: in a
+ * slot of the running call, in a cell of the running closure, or in the
+ * globals. Variables of enclosing lambdas get a cell in this closure, and in
+ * every closure in between.
+ * 
+ * @param   compiler    The compiler.
+ * @param   symbol  The variable's symbol ID.
+ * @param   variable    Receives the variable, if it's local or captured.
+ * @param   index   Receives the variable's slot or cell.
+ * @return  PLT_CAPTURE_LOCAL or PLT_CAPTURE_FREE, -1 if the variable is
+ *          global, or -2 if out of memory.
+ */
+static int
+resolve_variable(
+    plt_compiler* compiler,
+    const size_t symbol,
+    plt_scope_variable* variable,
+    size_t* index)
+{
+    // Search from the innermost local, so it shadows the others.
+    for (size_t slot = compiler->local_count; slot-- > 0;)
+        if (compiler->locals[slot].symbol == symbol)
+        {
+            *variable = compiler->locals[slot];
+            *index = slot;
+
+            return PLT_CAPTURE_LOCAL;
+        }
+
+    for (size_t cell = 0; cell < compiler->prototype->capture_count; cell++)
+        if (compiler->free_variables[cell].symbol == symbol)
+        {
+            *variable = compiler->free_variables[cell];
+            *index = cell;
+
+            return PLT_CAPTURE_FREE;
+        }
+
+    if (!compiler->parent)
+        return -1;
+
+    const int from =
+        resolve_variable(compiler->parent, symbol, variable, index);
+
+    // Running out of memory in an enclosing lambda is this lambda's error
+    // too, since only this compiler's status is passed on.
+    if (from == -2)
+    {
+        compile_error(
+            compiler,
+            compiler->parent->status,
+            compiler->parent->error_value);
+
+        return -2;
+    }
+
+    if (from < 0)
+        return from;
+
+    if (!add_free_variable(compiler, *variable, (unsigned int)from, *index))
+        return -2;
+
+    *index = compiler->prototype->capture_count - 1;
+
+    return PLT_CAPTURE_FREE;
+}
+
+/**
+ * Compiles a reference to a variable, or an assignment to one.
+ * 
+ * Variables are resolved here, once, so the code addresses locals and captured
+ * variables by where they are and globals by symbol ID, without searching for
+ * names as it runs.
+ * 
+ * @param   compiler    The compiler.
+ * @param   variable    The variable's name, a symbol.
+ * @param   is_assignment   Whether to set the variable to the value on top,
+ *                          rather than push its value.
+ * @return  One if the reference was compiled, otherwise zero.
+ */
+static int
+compile_variable(
+    plt_compiler* compiler,
+    const plt_value variable,
+    const int is_assignment)
+{
+    const size_t symbol = plt_symbol_value(variable);
+    plt_scope_variable resolved = { 0 };
+    size_t index = 0;
+
+    const int from = resolve_variable(compiler, symbol, &resolved, &index);
+    const int stack_effect = !is_assignment;
+    enum plt_opcode opcode;
+
+    if (from == -2)
+        return 0;
+
+    if (from == -1)
+    {
+        // Reserve the global's cell now, so the code can index it unchecked.
+        if (!reserve_global(compiler->vm, symbol))
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        opcode = is_assignment ? PLT_OP_SET_GLOBAL : PLT_OP_GLOBAL;
+        index = symbol;
+    }
+    else if (from == PLT_CAPTURE_LOCAL)
+        opcode = resolved.is_boxed
+            ? (is_assignment ? PLT_OP_SET_LOCAL_CELL : PLT_OP_LOCAL_CELL)
+            : (is_assignment ? PLT_OP_SET_LOCAL : PLT_OP_LOCAL);
+    // Captured variables that are assigned are always boxed.
+    else
+        opcode = resolved.is_boxed
+            ? (is_assignment ? PLT_OP_SET_FREE_CELL : PLT_OP_FREE_CELL)
+            : PLT_OP_FREE;
+
+    return emit_with_operand(compiler, opcode, index, stack_effect);
+}
+
+/**
+ * Brings a variable into scope, in the next free slot of the call.
+ * 
+ * @param   compiler    The compiler.
+ * @param   symbol  The variable's symbol ID.
+ * @param   is_boxed    Whether the variable will hold a box.
+ * @return  One if the variable is in scope, or zero if we're out of memory.
+ */
+static int
+add_local(plt_compiler* compiler, const size_t symbol, const size_t is_boxed)
+{
+    if (compiler->local_count == compiler->local_capacity)
+    {
+        const size_t capacity =
+            compiler->local_capacity ? 2 * compiler->local_capacity : 8;
+
+        plt_scope_variable* locals = reallocate(
+            compiler->vm->context,
+            compiler->locals,
+            capacity * sizeof(*compiler->locals));
+
+        if (!locals)
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        compiler->locals = locals;
+        compiler->local_capacity = capacity;
+    }
+
+    compiler->locals[compiler->local_count].symbol = symbol;
+    compiler->locals[compiler->local_count].is_boxed = is_boxed;
+    compiler->local_count++;
+
+    if (compiler->local_count > compiler->prototype->frame_size)
+        compiler->prototype->frame_size = compiler->local_count;
+
+    return 1;
+}
+
+/**
+ * Works out which region the code compiled so far should allocate in.
+ * 
+ * A call gets a region of its own when it allocates, but looks like it lets go
+ * of everything it allocates by the time it returns. The virtual machine
+ * checks what the compiler can't see, such as what the procedures it calls do.
+ * 
+ * @param   compiler    The compiler.
+ * @return  PLT_REGION_CALLER or PLT_REGION_LOCAL.
+ */
+static size_t
+infer_region(const plt_compiler* compiler)
+{
+    return compiler->allocates
+        && !compiler->returns_fresh
+        && !compiler->stores_outside
+        ? PLT_REGION_LOCAL
+        : PLT_REGION_CALLER;
+}
+
+static int compile_expression(
+    plt_compiler* compiler,
+    const plt_value form,
+    const int is_tail);
+
+/**
+ * Compiles a sequence of expressions, whose value is the last one's.
+ * 
+ * @param   compiler    The compiler.
+ * @param   body    The expressions, as a proper list.
+ * @param   is_tail Whether the body's value is returned as it is.
+ * @return  One if the body was compiled, otherwise zero.
+ */
+static int
+compile_body(plt_compiler* compiler, plt_value body, const int is_tail)
+{
+    if (body == PLT_EMPTY_LIST)
+        return emit_constant(compiler, PLT_UNSPECIFIED);
+
+    for (; body != PLT_EMPTY_LIST; body = plt_cdr(body))
+    {
+        const int is_last = plt_cdr(body) == PLT_EMPTY_LIST;
+
+        if (!compile_expression(compiler, plt_car(body), is_tail && is_last))
+            return 0;
+
+        if (!is_last && !emit(compiler, PLT_OP_POP, -1))
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Compiles a lambda into a child prototype, and the code that makes a closure
+ * over it.
+ * 
+ * @param   compiler    The compiler.
+ * @param   form    The whole lambda form, for error reporting.
+ * @param   parameters  The lambda's parameters, as a proper list of symbols.
+ * @param   body    The lambda's body, as a proper list.
+ * @param   compiled    Receives the child prototype. May be null.
+ * @return  One if the lambda was compiled, otherwise zero.
+ */
+static int
+compile_lambda(
+    plt_compiler* compiler,
+    const plt_value form,
+    const plt_value parameters,
+    const plt_value body,
+    const plt_prototype** compiled)
+{
+    plt_context* context = compiler->vm->context;
+    const long parameter_count = list_length(parameters);
+
+    if (parameter_count < 0 || body == PLT_EMPTY_LIST)
+        return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+    plt_prototype* prototype = plt_allocate_aligned(
+        context,
+        sizeof(plt_prototype),
+        sizeof(size_t));
+
+    if (!prototype)
+        return compile_error(compiler, PLT_EVAL_OUT_OF_MEMORY, PLT_UNSPECIFIED);
+
+    *prototype = (plt_prototype){ 0 };
+    prototype->parameter_count = (size_t)parameter_count;
+
+    plt_compiler child = { 0 };
+    child.vm = compiler->vm;
+    child.parent = compiler;
+    child.prototype = prototype;
+
+    for (plt_value p = parameters; p != PLT_EMPTY_LIST; p = plt_cdr(p))
+    {
+        if ((plt_car(p) & PLT_TAG_MASK) != PLT_TAG_SYMBOL)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        const size_t symbol = plt_symbol_value(plt_car(p));
+
+        if (!add_local(&child, symbol, needs_box(child.vm, body, symbol)))
+            return compile_error(compiler, child.status, child.error_value);
+    }
+
+    for (size_t slot = 0; slot < prototype->parameter_count; slot++)
+        if (child.locals[slot].is_boxed
+            && !emit_with_operand(&child, PLT_OP_BOX, slot, 0))
+            return compile_error(compiler, child.status, child.error_value);
+
+    if (!compile_body(&child, body, 1) || !emit(&child, PLT_OP_RETURN, -1))
+        return compile_error(compiler, child.status, child.error_value);
+
+    prototype->region = infer_region(&child);
+
+    if (compiled)
+        *compiled = prototype;
+
+    // A closure without free variables is the same every time, so make it
+    // once, now.
+    if (!prototype->capture_count)
+    {
+        plt_procedure_box* box = plt_allocate_headerless(
+            context,
+            sizeof(plt_procedure_box),
+            PLT_VALUE_ALIGNMENT);
+
+        if (!box)
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        box->type = PLT_VALUE_PROCEDURE;
+        box->prototype = prototype;
+
+        return emit_constant(compiler, (plt_value)box);
+    }
+
+    plt_prototype* parent = compiler->prototype;
+
+    if (parent->child_count == parent->child_capacity)
+    {
+        const size_t capacity =
+            parent->child_capacity ? 2 * parent->child_capacity : 4;
+
+        plt_prototype** children = reallocate(
+            context,
+            parent->children,
+            capacity * sizeof(*parent->children));
+
+        if (!children)
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        parent->children = children;
+        parent->child_capacity = capacity;
+    }
+
+    parent->children[parent->child_count] = prototype;
+
+    return emit_with_operand(
+        compiler,
+        PLT_OP_CLOSURE,
+        parent->child_count++,
+        1);
+}
+
+/**
+ * Compiles a named let, (let name ((variable value)...) body...), which calls
+ * a procedure bound to name in its own body: (lambda (variable...) body...).
+ * 
+ * @param   compiler    The compiler.
+ * @param   form    The whole form.
+ * @param   is_tail Whether the form's value is returned as it is.
+ * @return  One if the named let was compiled, otherwise zero.
+ */
+static int
+compile_named_let(
+    plt_compiler* compiler,
+    const plt_value form,
+    const int is_tail)
+{
+    const plt_value name = plt_car(plt_cdr(form));
+    const plt_value bindings = plt_car(plt_cdr(plt_cdr(form)));
+    const plt_value body = plt_cdr(plt_cdr(plt_cdr(form)));
+    const long binding_count = list_length(bindings);
+
+    if (binding_count < 0 || list_length(body) < 1)
+        return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+    // Gather the variables into a list for compile_lambda().
+    plt_value variables = PLT_EMPTY_LIST;
+    plt_value* tail = &variables;
+
+    for (plt_value b = bindings; b != PLT_EMPTY_LIST; b = plt_cdr(b))
+    {
+        if (list_length(plt_car(b)) != 2)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        *tail = plt_cons(
+            compiler->vm->context,
+            plt_car(plt_car(b)),
+            PLT_EMPTY_LIST);
+
+        if (*tail == PLT_EMPTY_LIST)
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        tail = &plt_pair_of(*tail)->cdr;
+    }
+
+    const size_t slot = compiler->local_count;
+    const size_t symbol = plt_symbol_value(name);
+    const size_t is_boxed = needs_box(compiler->vm, body, symbol);
+    const plt_prototype* procedure = 0;
+
+    // The procedure sees its own name, as a variable of the enclosing call.
+    if (!add_local(compiler, symbol, is_boxed))
+        return 0;
+
+    if (is_boxed)
+    {
+        // The box has to be there for the closure to capture it.
+        if (!emit_constant(compiler, PLT_UNSPECIFIED)
+            || !emit_with_operand(compiler, PLT_OP_BIND, slot, -1)
+            || !emit_with_operand(compiler, PLT_OP_BOX, slot, 0)
+            || !compile_lambda(compiler, form, variables, body, &procedure)
+            || !emit_with_operand(compiler, PLT_OP_SET_LOCAL_CELL, slot, 0)
+            || !emit(compiler, PLT_OP_POP, -1)
+            || !emit_with_operand(compiler, PLT_OP_LOCAL_CELL, slot, 1))
+            return 0;
+    }
+    else
+    {
+        if (!compile_lambda(compiler, form, variables, body, &procedure))
+            return 0;
+
+        // The closure copied the slot before anything was in it, so point the
+        // cell at the closure itself. Nothing else reads the slot.
+        for (size_t cell = 0; cell < procedure->capture_count; cell++)
+            if (procedure->captures[2 * cell] == PLT_CAPTURE_LOCAL
+                && procedure->captures[2 * cell + 1] == slot
+                && !emit_with_operand(compiler, PLT_OP_SELF, cell, 0))
+                return 0;
+    }
+
+    // The values don't see the name, and nothing else gets its slot.
+    compiler->locals[slot].symbol = PLT_NO_SYMBOL;
+
+    for (plt_value b = bindings; b != PLT_EMPTY_LIST; b = plt_cdr(b))
+        if (!compile_expression(compiler, plt_car(plt_cdr(plt_car(b))), 0))
+            return 0;
+
+    compiler->allocates = 1;
+
+    return emit_with_operand(
+        compiler,
+        is_tail ? PLT_OP_TAIL_CALL : PLT_OP_CALL,
+        (size_t)binding_count,
+        -(int)binding_count);
+}
+
+/**
+ * Compiles a special form, if the form is one.
+ * 
+ * @param   compiler    The compiler.
+ * @param   form    The form, a pair.
+ * @param   is_tail Whether the form's value is returned as it is.
+ * @param   handled Set to one if the form was a special form.
+ * @return  One unless compiling the special form failed.
+ */
+static int
+compile_special_form(
+    plt_compiler* compiler,
+    const plt_value form,
+    const int is_tail,
+    int* handled)
+{
+    const plt_vm* vm = compiler->vm;
+    const plt_value head = plt_car(form);
+    const plt_value rest = plt_cdr(form);
+    const long length = list_length(rest);
+
+    *handled = 1;
+
+    if (head == plt_make_symbol(vm->quote_symbol))
+    {
+        if (length != 1)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        return emit_constant(compiler, plt_car(rest));
+    }
+
+    if (head == plt_make_symbol(vm->if_symbol))
+    {
+        if (length != 2 && length != 3)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        if (!compile_expression(compiler, plt_car(rest), 0)
+            || !emit_with_operand(compiler, PLT_OP_JUMP_IF_FALSE, 0, -1))
+            return 0;
+
+        const size_t else_jump = compiler->prototype->code_length - 1;
+
+        if (!compile_expression(compiler, plt_car(plt_cdr(rest)), is_tail)
+            || !emit_with_operand(compiler, PLT_OP_JUMP, 0, 0))
+            return 0;
+
+        const size_t end_jump = compiler->prototype->code_length - 1;
+        compiler->prototype->code[else_jump] =
+            (unsigned int)compiler->prototype->code_length;
+
+        // Only one of the branches runs, so only one of their values is left.
+        compiler->stack_depth--;
+
+        if (!(length == 3
+            ? compile_expression(
+                compiler,
+                plt_car(plt_cdr(plt_cdr(rest))),
+                is_tail)
+            : emit_constant(compiler, PLT_UNSPECIFIED)))
+            return 0;
+
+        compiler->prototype->code[end_jump] =
+            (unsigned int)compiler->prototype->code_length;
+
+        return 1;
+    }
+
+    if (head == plt_make_symbol(vm->define_symbol))
+    {
+        if (length < 2 || compiler->parent)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        plt_value target = plt_car(rest);
+
+        // (define (name parameters...) body...)
+        if ((target & PLT_TAG_MASK) == PLT_TAG_PAIR)
+        {
+            if (!compile_lambda(
+                compiler,
+                form,
+                plt_cdr(target),
+                plt_cdr(rest),
+                0))
+                return 0;
+
+            target = plt_car(target);
+        }
+        else if (length != 2
+            || !compile_expression(compiler, plt_car(plt_cdr(rest)), 0))
+            return length != 2
+                ? compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form)
+                : 0;
+
+        if ((target & PLT_TAG_MASK) != PLT_TAG_SYMBOL)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        if (!reserve_global(compiler->vm, plt_symbol_value(target)))
+            return compile_error(
+                compiler,
+                PLT_EVAL_OUT_OF_MEMORY,
+                PLT_UNSPECIFIED);
+
+        return emit_with_operand(
+            compiler,
+            PLT_OP_DEFINE,
+            plt_symbol_value(target),
+            0);
+    }
+
+    if (head == plt_make_symbol(vm->set_symbol))
+    {
+        if (length != 2
+            || (plt_car(rest) & PLT_TAG_MASK) != PLT_TAG_SYMBOL)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        return compile_expression(compiler, plt_car(plt_cdr(rest)), 0)
+            && compile_variable(compiler, plt_car(rest), 1);
+    }
+
+    if (head == plt_make_symbol(vm->lambda_symbol))
+    {
+        if (length < 2)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        const plt_prototype* procedure = 0;
+
+        if (!compile_lambda(
+            compiler,
+            form,
+            plt_car(rest),
+            plt_cdr(rest),
+            &procedure))
+            return 0;
+
+        // Closures without free variables are made at compile time.
+        if (is_tail && procedure->capture_count)
+            compiler->returns_fresh = 1;
+
+        return 1;
+    }
+
+    if (head == plt_make_symbol(vm->begin_symbol))
+    {
+        if (length < 0)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        return compile_body(compiler, rest, is_tail);
+    }
+
+    // (let ((name value)...) body...) gives its variables the next free slots
+    // of the call, rather than a call of their own. Slots aren't reused once
+    // the let is over, so every let variable of a call has a slot to itself,
+    // whatever closures over it do.
+    if (head == plt_make_symbol(vm->let_symbol))
+    {
+        if (length < 2)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        if ((plt_car(rest) & PLT_TAG_MASK) == PLT_TAG_SYMBOL)
+            return compile_named_let(compiler, form, is_tail);
+
+        const plt_value bindings = plt_car(rest);
+
+        if (list_length(bindings) < 0)
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        for (plt_value b = bindings; b != PLT_EMPTY_LIST; b = plt_cdr(b))
+            if (list_length(plt_car(b)) != 2
+                || (plt_car(plt_car(b)) & PLT_TAG_MASK) != PLT_TAG_SYMBOL)
+                return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        // The values are computed before any of the variables are in scope,
+        // then bound in order.
+        for (plt_value b = bindings; b != PLT_EMPTY_LIST; b = plt_cdr(b))
+            if (!compile_expression(compiler, plt_car(plt_cdr(plt_car(b))), 0))
+                return 0;
+
+        // Lets within the values have had their slots by now.
+        const size_t first_slot = compiler->local_count;
+
+        for (plt_value b = bindings; b != PLT_EMPTY_LIST; b = plt_cdr(b))
+        {
+            const size_t symbol = plt_symbol_value(plt_car(plt_car(b)));
+
+            if (!add_local(
+                compiler,
+                symbol,
+                needs_box(vm, plt_cdr(rest), symbol)))
+                return 0;
+        }
+
+        for (size_t slot = compiler->local_count; slot-- > first_slot;)
+            if (!emit_with_operand(compiler, PLT_OP_BIND, slot, -1)
+                || (compiler->locals[slot].is_boxed
+                    && !emit_with_operand(compiler, PLT_OP_BOX, slot, 0)))
+                return 0;
+
+        if (!compile_body(compiler, plt_cdr(rest), is_tail))
+            return 0;
+
+        // Take the variables out of scope, but keep their slots.
+        for (size_t slot = first_slot; slot < compiler->local_count;)
+            compiler->locals[slot++].symbol = PLT_NO_SYMBOL;
+
+        return 1;
+    }
+
+    *handled = 0;
+
+    return 1;
+}
+
+/**
+ * Takes into account what a call might allocate, for inferring the region of
+ * the code that makes it.
+ * 
+ * Calls to a global that's a primitive when the code is compiled are assumed
+ * to allocate what the primitive does. Any other call might allocate anything.
+ * 
+ * @param   compiler    The compiler.
+ * @param   operator_start  Where the code for the call's operator begins.
+ * @param   is_tail Whether the call's value is returned as it is.
+ */
+static void
+note_call(
+    plt_compiler* compiler,
+    const size_t operator_start,
+    const int is_tail)
+{
+    const unsigned int* code = compiler->prototype->code + operator_start;
+    const plt_value* globals = compiler->vm->globals;
+    enum plt_primitive_allocation allocation = PLT_PRIMITIVE_ALLOCATES;
+
+    if (code[0] == PLT_OP_GLOBAL
+        && (globals[code[1]] & PLT_TAG_MASK) == PLT_TAG_BOX
+        && plt_type_of(globals[code[1]]) == PLT_VALUE_PRIMITIVE)
+        allocation = ((const plt_primitive_box*)globals[code[1]])->allocation;
+
+    if (allocation != PLT_PRIMITIVE_PURE)
+        compiler->allocates = 1;
+
+    if (allocation == PLT_PRIMITIVE_CONSTRUCTS && is_tail)
+        compiler->returns_fresh = 1;
+}
+
+/**
+ * Compiles an expression, leaving its value on the stack.
+ * 
+ * Compiling recurses through nested expressions, so code (unlike data) can't
+ * be nested arbitrarily deeply.
+ * 
+ * A call in tail position (one whose value is returned as it is) replaces the
+ * running procedure, rather than returning to it.
+ * 
+ * @param   compiler    The compiler.
+ * @param   form    The expression.
+ * @param   is_tail Whether the expression's value is returned as it is.
+ * @return  One if the expression was compiled, otherwise zero.
+ */
+static int
+compile_expression(
+    plt_compiler* compiler,
+    const plt_value form,
+    const int is_tail)
+{
+    switch (plt_type_of(form))
+    {
+        case PLT_VALUE_SYMBOL:
+            return compile_variable(compiler, form, 0);
+
+        case PLT_VALUE_PAIR:
+            break;
+
+        case PLT_VALUE_EMPTY_LIST:
+            return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+        default:
+            return emit_constant(compiler, form);
+    }
+
+    const long argument_count = list_length(plt_cdr(form));
+
+    if (argument_count < 0)
+        return compile_error(compiler, PLT_EVAL_SYNTAX_ERROR, form);
+
+    int handled = 0;
+
+    if (!compile_special_form(compiler, form, is_tail, &handled))
+        return 0;
+
+    if (handled)
+        return 1;
+
+    const size_t operator_start = compiler->prototype->code_length;
+
+    for (plt_value item = form; item != PLT_EMPTY_LIST; item = plt_cdr(item))
+        if (!compile_expression(compiler, plt_car(item), 0))
+            return 0;
+
+    note_call(compiler, operator_start, is_tail);
+
+    return emit_with_operand(
+        compiler,
+        is_tail ? PLT_OP_TAIL_CALL : PLT_OP_CALL,
+        (size_t)argument_count,
+        -(int)argument_count);
+}
+
+/**
+ * Compiles a top level form into a prototype that takes no arguments.
+ * 
+ * @param   vm  The virtual machine the code is for.
+ * @param   form    The form.
+ * @param   prototype   Receives the compiled form.
+ * @return  PLT_EVAL_OK, or why the form couldn't be compiled (with the
+ *          offending form).
+ */
+plt_eval_result
+plt_compile(plt_vm* vm, const plt_value form, plt_prototype** prototype)
+{
+    plt_eval_result result;
+    result.status = PLT_EVAL_OK;
+    result.value = PLT_UNSPECIFIED;
+
+    *prototype = plt_allocate_aligned(
+        vm->context,
+        sizeof(plt_prototype),
+        sizeof(size_t));
+
+    if (!*prototype)
+    {
+        result.status = PLT_EVAL_OUT_OF_MEMORY;
+        return result;
+    }
+
+    **prototype = (plt_prototype){ 0 };
+
+    plt_compiler compiler = { 0 };
+    compiler.vm = vm;
+    compiler.prototype = *prototype;
+
+    if (!compile_expression(&compiler, form, 1)
+        || !emit(&compiler, PLT_OP_RETURN, -1))
+    {
+        result.status = compiler.status;
+        result.value = compiler.error_value;
+    }
+
+    (*prototype)->region = infer_region(&compiler);
+
+    return result;
+}
+
+/// VIRTUAL MACHINE
+
+// GCC and Clang can jump straight from one instruction to the next through a
+// table of label addresses, which predicts far better than one shared switch.
+// Define PILOT_NO_COMPUTED_GOTO to use the portable switch anyway.
+#if (defined(__GNUC__) || defined(__clang__)) \
+    && !defined(PILOT_NO_COMPUTED_GOTO)
+#define __vm_dispatch goto *dispatch_table[*ip++];
+#define __vm_case(O) op_ ## O
+#define __vm_next goto *dispatch_table[*ip++]
+#else
+#define __vm_dispatch for (;;) switch ((enum plt_opcode)*ip++)
+#define __vm_case(O) case PLT_OP_ ## O
+#define __vm_next continue
+#endif
+
+/**
+ * Records that memory in the arena is referred to from outside of the running
+ * calls' regions, so that none of the regions it's in are freed.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   address The address of the memory's last byte (or of any byte in
+ *                  its last word).
+ */
+static void
+note_escaped_address(plt_vm* vm, const size_t address)
+{
+    if (address > vm->escape_ceiling)
+        vm->escape_ceiling = address;
+}
+
+/**
+ * Records that a value has been stored somewhere that may outlive the regions
+ * of the running calls, so that none of the regions it's in are freed.
+ * 
+ * The virtual machine does this itself when it assigns a global or a captured
+ * variable. Primitives that keep hold of a value past the call have to do it
+ * too.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   value   The value.
+ */
+void
+plt_note_escape(plt_vm* vm, const plt_value value)
+{
+    // Only pairs and boxes point into the arena, and they're at least a word.
+    if (!(value & 3))
+        note_escaped_address(vm, value | PLT_TAG_MASK);
+}
+
+/**
+ * Checks whether the memory allocated since a mark can be freed: nothing
+ * outside of the running calls refers to it, and neither do the given values.
+ * 
+ * Only memory in the arena the mark was made in can be freed, so that whether
+ * something's in it is a matter of comparing addresses.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   region  Where the memory begins.
+ * @param   values  The values that will still be used.
+ * @param   count   How many values there are.
+ * @return  One if the memory can be freed, otherwise zero.
+ */
+static int
+is_region_free(
+    const plt_vm* vm,
+    const plt_arena_mark* region,
+    const plt_value* values,
+    const size_t count)
+{
+    const plt_context* context = vm->context;
+    const size_t start = (size_t)region->arena_cursor;
+
+    if (context->arena_cursor == region->arena_cursor
+        || context->arena != region->arena
+        || context->blocks != region->blocks
+        || vm->escape_ceiling >= start)
+        return 0;
+
+    for (size_t i = 0; i < count; i++)
+        if (!(values[i] & 3) && (values[i] | PLT_TAG_MASK) >= start)
+            return 0;
+
+    return 1;
+}
+
+/**
+ * Gives a call a region of its own, from now on.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   frame   The call's frame.
+ */
+static void
+open_region(plt_vm* vm, plt_call_frame* frame)
+{
+    frame->has_region = 1;
+    frame->region = plt_mark(vm->context);
+    frame->tail_region = frame->region;
+}
+
+/**
+ * Frees what a call with a region allocated since its latest tail call, as it
+ * makes another, unless the callee or its arguments refer to it. Otherwise,
+ * the next tail call can only free what's allocated from now on.
+ * 
+ * Either way, the call's whole region is still freed when it returns, so a
+ * loop that builds up a result only keeps it until then.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   frame   The call's frame.
+ * @param   values  The callee, followed by its arguments.
+ * @param   count   How many values there are.
+ */
+static void
+free_tail_region(
+    plt_vm* vm,
+    plt_call_frame* frame,
+    const plt_value* values,
+    const size_t count)
+{
+    // Loops that don't allocate shouldn't pay for a new mark.
+    if (vm->context->arena_cursor == frame->tail_region.arena_cursor)
+        return;
+
+    if (is_region_free(vm, &frame->tail_region, values, count))
+        plt_rewind(vm->context, frame->tail_region);
+    else
+        frame->tail_region = plt_mark(vm->context);
+}
+
+/**
+ * Frees the region of a call as it returns, unless something outside of the
+ * region might still point into it.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   frame   The call's frame.
+ * @param   result  What the call returns.
+ */
+static void
+close_region(plt_vm* vm, const plt_call_frame* frame, const plt_value result)
+{
+    if (is_region_free(vm, &frame->region, &result, 1))
+        plt_rewind(vm->context, frame->region);
+}
+
+/**
+ * Makes room for another call frame.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   depth   How many call frames are in use.
+ * @return  One if there's room, or zero if we're out of memory.
+ */
+static int
+reserve_call_frame(plt_vm* vm, const size_t depth)
+{
+    if (depth < vm->frame_capacity)
+        return 1;
+
+    const size_t capacity = vm->frame_capacity ? 2 * vm->frame_capacity : 16;
+
+    plt_call_frame* frames = reallocate(
+        vm->context,
+        vm->frames,
+        capacity * sizeof(*vm->frames));
+
+    if (!frames)
+        return 0;
+
+    vm->frames = frames;
+    vm->frame_capacity = capacity;
+
+    // The call frames may have grown into a region, and have to outlive it.
+    note_escaped_address(vm, (size_t)(frames + capacity) - 1);
+
+    return 1;
+}
+
+/**
+ * Checks there's room on the value stack for a call.
+ * 
+ * @param   prototype   The procedure's prototype.
+ * @param   base    Where the callee sits on the stack.
+ * @param   stack_end   The end of the stack.
+ * @return  One if the call's variables and temporaries fit, otherwise zero.
+ */
+static int
+fits_on_stack(
+    const plt_prototype* prototype,
+    const plt_value* base,
+    const plt_value* stack_end)
+{
+    return 1 + prototype->frame_size + prototype->max_stack_depth
+        <= (size_t)(stack_end - base);
+}
+
+/**
+ * Runs a compiled top level form.
+ * 
+ * Procedure calls don't recurse in C, so Scheme code can recurse as deeply as
+ * the value stack allows. A call's variables live on the value stack, after
+ * the callee and in place of its arguments, and tail calls replace the
+ * running call's, so loops written as tail recursion run in constant space.
+ * 
+ * The arena is only touched to make closures, boxes and what primitives
+ * allocate. Calls the compiler gave a region of their own mark the arena, and
+ * rewind it as they return if nothing they allocated is still referred to.
+ * So does the form itself. A call with a region also frees what it allocated
+ * since its latest tail call whenever it makes another, unless the callee or
+ * its arguments refer to it, so loops written as tail recursion can throw away
+ * what each time around allocates. Objects on the pools' free lists are only
+ * dropped if they're in the memory freed.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   prototype   The compiled form, from plt_compile().
+ * @return  The form's value, or why there isn't one.
+ */
+plt_eval_result
+plt_execute(plt_vm* vm, const plt_prototype* prototype)
+{
+    #if (defined(__GNUC__) || defined(__clang__)) \
+        && !defined(PILOT_NO_COMPUTED_GOTO)
+    static void* dispatch_table[] = {
+        #define _(O) &&op_ ## O,
+        OPCODES
+        #undef _
+    };
+    #endif
+
+    plt_eval_result result;
+    result.status = PLT_EVAL_OK;
+    result.value = PLT_UNSPECIFIED;
+
+    const plt_value* stack_end = vm->stack + vm->stack_size;
+    // The callee of the running call, then its variables.
+    plt_value* base = vm->stack;
+    plt_value* sp = base + 1 + prototype->frame_size;
+    const unsigned int* ip = prototype->code;
+    const plt_value* constants = prototype->constants;
+    size_t depth = 0;
+    plt_value value;
+    // Stands in for a call frame for the form itself, which has none, to keep
+    // track of its region.
+    plt_call_frame outermost;
+    outermost.has_region = 0;
+
+    vm->status = PLT_EVAL_OK;
+
+    // Whatever escaped before is older than any region to come.
+    vm->escape_ceiling = 0;
+
+    if (!fits_on_stack(prototype, base, stack_end))
+    {
+        result.status = PLT_EVAL_STACK_OVERFLOW;
+        return result;
+    }
+
+    // A top level form isn't a closure, and has nothing to capture.
+    base[0] = PLT_UNSPECIFIED;
+
+    if (prototype->region == PLT_REGION_LOCAL)
+        open_region(vm, &outermost);
+
+    __vm_dispatch
+    {
+        __vm_case(CONSTANT):
+            *sp++ = constants[*ip++];
+            __vm_next;
+
+        __vm_case(LOCAL):
+            *sp++ = base[1 + *ip++];
+            __vm_next;
+
+        __vm_case(SET_LOCAL):
+            base[1 + *ip++] = sp[-1];
+            sp[-1] = PLT_UNSPECIFIED;
+            __vm_next;
+
+        __vm_case(FREE):
+            *sp++ = ((const plt_procedure_box*)base[0])->cells[*ip++];
+            __vm_next;
+
+        __vm_case(LOCAL_CELL):
+            *sp++ = *(const plt_value*)base[1 + *ip++];
+            __vm_next;
+
+        __vm_case(SET_LOCAL_CELL):
+            *(plt_value*)base[1 + *ip++] = sp[-1];
+            sp[-1] = PLT_UNSPECIFIED;
+            __vm_next;
+
+        __vm_case(FREE_CELL):
+            *sp++ = *(const plt_value*)
+                ((const plt_procedure_box*)base[0])->cells[*ip++];
+            __vm_next;
+
+        __vm_case(SET_FREE_CELL):
+            plt_note_escape(vm, sp[-1]);
+            *(plt_value*)((const plt_procedure_box*)base[0])->cells[*ip++] =
+                sp[-1];
+            sp[-1] = PLT_UNSPECIFIED;
+            __vm_next;
+
+        __vm_case(GLOBAL):
+            value = vm->globals[*ip];
+
+            if (value == PLT_UNBOUND)
+            {
+                result.status = PLT_EVAL_UNBOUND_VARIABLE;
+                result.value = plt_make_symbol(*ip);
+                goto error;
+            }
+
+            *sp++ = value;
+            ip++;
+            __vm_next;
+
+        __vm_case(SET_GLOBAL):
+            if (vm->globals[*ip] == PLT_UNBOUND)
+            {
+                result.status = PLT_EVAL_UNBOUND_VARIABLE;
+                result.value = plt_make_symbol(*ip);
+                goto error;
+            }
+
+            plt_note_escape(vm, sp[-1]);
+            vm->globals[*ip++] = sp[-1];
+            sp[-1] = PLT_UNSPECIFIED;
+            __vm_next;
+
+        __vm_case(BIND):
+            base[1 + *ip++] = *--sp;
+            __vm_next;
+
+        __vm_case(BOX):
+        {
+            plt_value* box = plt_allocate_headerless(
+                vm->context,
+                sizeof(plt_value),
+                PLT_VALUE_ALIGNMENT);
+
+            if (!box)
+            {
+                result.status = PLT_EVAL_OUT_OF_MEMORY;
+                goto error;
+            }
+
+            *box = base[1 + *ip];
+            base[1 + *ip++] = (plt_value)box;
+            __vm_next;
+        }
+
+        __vm_case(DEFINE):
+            plt_note_escape(vm, sp[-1]);
+            vm->globals[*ip++] = sp[-1];
+            sp[-1] = PLT_UNSPECIFIED;
+            __vm_next;
+
+        __vm_case(POP):
+            sp--;
+            __vm_next;
+
+        __vm_case(JUMP):
+            ip = prototype->code + *ip;
+            __vm_next;
+
+        __vm_case(JUMP_IF_FALSE):
+            if (*--sp == PLT_FALSE)
+                ip = prototype->code + *ip;
+            else
+                ip++;
+            __vm_next;
+
+        __vm_case(CLOSURE):
+        {
+            const plt_prototype* child = prototype->children[*ip++];
+            plt_procedure_box* box = plt_allocate_headerless(
+                vm->context,
+                sizeof(plt_procedure_box)
+                    + child->capture_count * sizeof(plt_value),
+                PLT_VALUE_ALIGNMENT);
+
+            if (!box)
+            {
+                result.status = PLT_EVAL_OUT_OF_MEMORY;
+                goto error;
+            }
+
+            box->type = PLT_VALUE_PROCEDURE;
+            box->prototype = child;
+
+            for (size_t i = 0; i < child->capture_count; i++)
+            {
+                const unsigned int index = child->captures[2 * i + 1];
+
+                box->cells[i] = child->captures[2 * i] == PLT_CAPTURE_LOCAL
+                    ? base[1 + index]
+                    : ((const plt_procedure_box*)base[0])->cells[index];
+            }
+
+            *sp++ = (plt_value)box;
+            __vm_next;
+        }
+
+        __vm_case(SELF):
+            ((plt_procedure_box*)sp[-1])->cells[*ip++] = sp[-1];
+            __vm_next;
+
+        __vm_case(CALL):
+        __vm_case(TAIL_CALL):
+        {
+            const int is_tail_call = ip[-1] == PLT_OP_TAIL_CALL;
+            const size_t argument_count = *ip++;
+            plt_value* arguments = sp - argument_count;
+            const plt_value callee = arguments[-1];
+
+            if ((callee & PLT_TAG_MASK) != PLT_TAG_BOX)
+            {
+                result.status = PLT_EVAL_NOT_A_PROCEDURE;
+                result.value = callee;
+                goto error;
+            }
+
+            if (*(const size_t*)callee == PLT_VALUE_PRIMITIVE)
+            {
+                const plt_primitive_box* primitive =
+                    (const plt_primitive_box*)callee;
+
+                if (primitive->arity >= 0
+                    && (size_t)primitive->arity != argument_count)
+                {
+                    result.status = PLT_EVAL_WRONG_ARGUMENT_COUNT;
+                    result.value = callee;
+                    goto error;
+                }
+
+                value = primitive->function(vm, arguments, argument_count);
+
+                if (vm->status != PLT_EVAL_OK)
+                {
+                    result.status = vm->status;
+                    result.value = vm->error_value;
+                    goto error;
+                }
+
+                if (is_tail_call)
+                    goto return_value;
+
+                sp = arguments;
+                sp[-1] = value;
+                __vm_next;
+            }
+
+            if (*(const size_t*)callee != PLT_VALUE_PROCEDURE)
+            {
+                result.status = PLT_EVAL_NOT_A_PROCEDURE;
+                result.value = callee;
+                goto error;
+            }
+
+            const plt_prototype* callee_prototype =
+                ((const plt_procedure_box*)callee)->prototype;
+
+            if (callee_prototype->parameter_count != argument_count)
+            {
+                result.status = PLT_EVAL_WRONG_ARGUMENT_COUNT;
+                result.value = callee;
+                goto error;
+            }
+
+            if (is_tail_call)
+            {
+                plt_call_frame* running =
+                    depth ? &vm->frames[depth - 1] : &outermost;
+
+                // The region of the running call carries on into the callee,
+                // or the callee starts one if it would have had its own.
+                if (running->has_region)
+                    free_tail_region(
+                        vm,
+                        running,
+                        arguments - 1,
+                        argument_count + 1);
+                else if (callee_prototype->region == PLT_REGION_LOCAL)
+                    open_region(vm, running);
+
+                // Slide the callee and its arguments down over the running
+                // call's.
+                for (size_t i = 0; i <= argument_count; i++)
+                    base[i] = arguments[i - 1];
+            }
+            else
+            {
+                if (!reserve_call_frame(vm, depth))
+                {
+                    result.status = PLT_EVAL_OUT_OF_MEMORY;
+                    goto error;
+                }
+
+                plt_call_frame* frame = &vm->frames[depth++];
+                frame->prototype = prototype;
+                frame->return_address = ip;
+                frame->base = base;
+                frame->has_region = 0;
+
+                if (callee_prototype->region == PLT_REGION_LOCAL)
+                    open_region(vm, frame);
+
+                base = arguments - 1;
+            }
+
+            if (!fits_on_stack(callee_prototype, base, stack_end))
+            {
+                result.status = PLT_EVAL_STACK_OVERFLOW;
+                goto error;
+            }
+
+            prototype = callee_prototype;
+            constants = prototype->constants;
+            sp = base + 1 + prototype->frame_size;
+            ip = prototype->code;
+            __vm_next;
+        }
+
+        __vm_case(RETURN):
+            value = *--sp;
+
+        return_value:
+            if (depth == 0)
+            {
+                if (outermost.has_region)
+                    close_region(vm, &outermost, value);
 
-    const size_t actual_allocation_size = requested_size + sizeof(size_t);
+                result.value = value;
+                return result;
+            }
 
-    if (arena_length - used_length < actual_allocation_size)
-    {
-        #ifdef PLT_OUT_OF_MEMORY
-        PLT_OUT_OF_MEMORY(used_length + actual_allocation_size, arena_length) ;
-        #endif
+            sp = base;
+            *sp++ = value;
 
-        return 0;
-    }
+            const plt_call_frame* frame = &vm->frames[--depth];
 
-    size_t* allocated_pointer = arena_cursor;
-    arena_cursor = (void*)((size_t)arena_cursor + actual_allocation_size);
+            if (frame->has_region)
+                close_region(vm, frame, value);
 
-    *allocated_pointer = requested_size;
+            prototype = frame->prototype;
+            constants = prototype->constants;
+            ip = frame->return_address;
+            base = frame->base;
+            __vm_next;
+    }
 
-    return (void*)((size_t)allocated_pointer + sizeof(size_t));
+error:
+    return result;
 }
 
-/**
- * Budget memcpy().
- * 
- * Copies data from source to destination. Literally memcpy().
- * 
- * @param   source  Pointer to source data.
- * @param   source_size Better safe than sorry.
- * @param   destination Pointer to data destination.
- */
-static void
-copy(const char* source, const size_t source_size, char* destination)
-{
-    for (size_t i = 0; i < source_size; i++)
-        destination[i] = source[i];
-}
+#undef __vm_dispatch
+#undef __vm_case
+#undef __vm_next
+
+/// PRIMITIVES
 
 /**
- * Reallocates the given (allocated) pointer.
+ * Checks that a value is a number, raising an error if it isn't.
  * 
- * Moves the pointer to a new region of the memory pool where it is allocated
- * the requested new_size of bytes. All data from the old region is copied over,
- * if the pointer is not null. The old pointer isn't cleaned up because we're
- * using a simple linear allocator that doesn't care about reclaiming space.
- * 
- * @param   pointer The pointer to reallocate.
- * @param   new_size    The number of bytes to allocate to the pointer.
- * @return  A pointer to the newly allocated memory (or null if out of memory).
+ * @param   vm  The virtual machine running the primitive.
+ * @param   value   The value.
+ * @return  One if the value is a fixnum or a flonum, otherwise zero.
  */
-static void*
-reallocate(const void* pointer, const size_t new_size)
+static int
+check_number(plt_vm* vm, const plt_value value)
 {
-    void* new_pointer = allocate(new_size);
-
-    const size_t* old_size = (size_t*)((size_t)pointer - sizeof(size_t));
+    if ((value & 1)
+        || ((value & PLT_TAG_MASK) == PLT_TAG_BOX
+            && *(const size_t*)value == PLT_VALUE_FLONUM))
+        return 1;
 
-    if (pointer && new_pointer)
-        copy(pointer, *old_size, new_pointer);
+    plt_raise(vm, PLT_EVAL_WRONG_TYPE, value);
 
-    return new_pointer;
+    return 0;
 }
 
-/// DYNAMIC BUFFERS
-
 /**
- * Appends a value to the end of a stretchy buffer. After appending, tags a null
- * terminator to the end of the stretchy buffer.
- * 
- * NOTE: The null terminator trick may not work for struct types!
+ * Converts a number to a double.
  * 
- * @param b Either a NULL pointer or pointer to a stretchy buffer.
- * @param value The value to append to the stretchy buffer.
- * @return  Zero.
+ * @param   value   A fixnum or a flonum.
+ * @return  Its value as a double.
  */
-#define buffer_append(b, value) \
-    (__buffer_maybe_grow(b, 1), \
-    (b)[__buffer_used(b)++] = (value), \
-    (b)[__buffer_used(b)] = 0)
+static double
+number_to_double(const plt_value value)
+{
+    return (value & 1)
+        ? (double)plt_fixnum_value(value)
+        : plt_flonum_value(value);
+}
 
 /**
- * Returns the number of items currently in the stretchy buffer.
+ * Makes the result of fixnum arithmetic, which becomes a flonum if it doesn't
+ * fit a fixnum.
  * 
- * @param b Either a NULL pointer or a pointer to a stretchy buffer.
- * @return  The number of items in the stretchy buffer. (Zero for NULL pointer.)
+ * @param   vm  The virtual machine running the primitive.
+ * @param   value   The result.
+ * @return  The result as a fixnum or flonum.
  */
-#define buffer_count(b) ((b) ? __buffer_used(b) : 0)
+static plt_value
+make_integer(plt_vm* vm, const long long value)
+{
+    if (value >= PLT_FIXNUM_MIN && value <= PLT_FIXNUM_MAX)
+        return plt_make_fixnum(value);
 
-/**
- * Sets the "used" section of the stretchy buffer header to 0, effectively 
- * resetting the buffer.
- * 
- * @param b Either a NULL pointer or a pointer to a stretchy buffer.
- * @return  Zero.
- */
-#define buffer_reset(b) ((b) ? __buffer_used(b) = 0 : 0)
+    const plt_value flonum = plt_make_flonum(vm->context, (double)value);
 
-/**
- * Retrieves the raw stretchy buffer as a size_t*. This allows direct access to
- * the 'size' and 'used' values, stored at index 0 and index 1, respectively.
- * 
- * @param b A pointer to a stretchy buffer.
- * @return  The pointer to the raw stretchy buffer.
- */
-#define __buffer_raw(b) \
-    ((size_t*)((size_t)(b) - (sizeof(size_t) * 2)))
+    if (flonum == PLT_EMPTY_LIST)
+        return plt_raise(vm, PLT_EVAL_OUT_OF_MEMORY, PLT_UNSPECIFIED);
 
-/**
- * Retrieves the 'size' value from a stretchy buffer.
- * 
- * @param b A pointer to a stretchy buffer.
- * @return  The amount of space allocated to the stretchy buffer.
- */
-#define __buffer_size(b) __buffer_raw(b)[0]
+    return flonum;
+}
 
 /**
- * Retrieves the 'used' value from a stretchy buffer.
+ * Makes the result of flonum arithmetic.
  * 
- * @param b A pointer to a stretchy buffer.
- * @return  The number of items in the stretchy buffer.
+ * @param   vm  The virtual machine running the primitive.
+ * @param   value   The result.
+ * @return  The result as a flonum.
  */
-#define __buffer_used(b) __buffer_raw(b)[1]
+static plt_value
+make_flonum(plt_vm* vm, const double value)
+{
+    const plt_value flonum = plt_make_flonum(vm->context, value);
 
-/**
- * Decides if a stretchy buffer needs to grow to accomodate more elements.
- * 
- * @param b Either a NULL pointer or a pointer to a stretchy buffer.
- * @param increment The number of new elements the buffer needs to accomodate.
- * @return  Zero if buffer has space, or one if buffer needs to be reallocated.
- */
-#define __buffer_needs_to_grow(b, increment) \
-    ((b) == 0 || __buffer_used(b) + (increment) >= __buffer_size(b))
+    if (flonum == PLT_EMPTY_LIST)
+        return plt_raise(vm, PLT_EVAL_OUT_OF_MEMORY, PLT_UNSPECIFIED);
 
-/**
- * Grows the stretch buffer by calling __buffer_growf() and then assigning the
- * passed buffer to the newly allocated pointer.
- * 
- * @param b Either a NULL pointer or a pointer to a stretchy buffer.
- * @param increment The number of new elements the buffer needs to accomodate.
- * @return  A pointer to the reallocated buffer.
- */ 
-#define __buffer_grow(b, increment) \
-    (*((void**)&(b)) = __buffer_growf((b), (increment), sizeof(*(b))))
+    return flonum;
+}
 
-/**
- * Optionally grows the stretchy buffer if the buffer needs to grow.
- * 
- * @param b Either a null pointer or a pointer to a stretchy buffer.
- * @param increment The number of new elements the buffer needs to accomodate.
- * @return  Zero or the pointer to the reallocated buffer.
- */
-#define __buffer_maybe_grow(b, increment) \
-    (__buffer_needs_to_grow(b, (increment))) \
-    ? __buffer_grow(b, (increment)) \
-    : 0
+// Defines a primitive that folds an arithmetic operator over its arguments,
+// in fixnums for as long as every argument is a fixnum.
+#define __define_arithmetic(name, operator, identity) \
+    static plt_value \
+    name(plt_vm* vm, const plt_value* arguments, size_t argument_count) \
+    { \
+        long long fixnum = identity; \
+        double flonum = identity; \
+        int is_flonum = 0; \
+        size_t i = 0; \
+        /* With more than one argument, start from the first. */ \
+        if (argument_count > 1) \
+        { \
+            if (!check_number(vm, arguments[0])) \
+                return PLT_UNSPECIFIED; \
+            is_flonum = !(arguments[0] & 1); \
+            if (is_flonum) \
+                flonum = plt_flonum_value(arguments[0]); \
+            else \
+                fixnum = plt_fixnum_value(arguments[0]); \
+            i = 1; \
+        } \
+        for (; i < argument_count; i++) \
+        { \
+            if (!check_number(vm, arguments[i])) \
+                return PLT_UNSPECIFIED; \
+            if (!is_flonum && (arguments[i] & 1)) \
+            { \
+                const long long operand = plt_fixnum_value(arguments[i]); \
+                const double estimate = (double)fixnum operator (double)operand; \
+                /* Fixnums are small enough that + and - can't overflow, and */ \
+                /* the estimate catches any * that would. */ \
+                if (estimate > -9.2e18 && estimate < 9.2e18) \
+                { \
+                    fixnum = fixnum operator operand; \
+                    if (fixnum >= PLT_FIXNUM_MIN && fixnum <= PLT_FIXNUM_MAX) \
+                        continue; \
+                } \
+                flonum = estimate; \
+                is_flonum = 1; \
+                continue; \
+            } \
+            if (!is_flonum) \
+            { \
+                flonum = (double)fixnum; \
+                is_flonum = 1; \
+            } \
+            flonum = flonum operator number_to_double(arguments[i]); \
+        } \
+        return is_flonum ? make_flonum(vm, flonum) : make_integer(vm, fixnum); \
+    }
+
+__define_arithmetic(primitive_add, +, 0)
+__define_arithmetic(primitive_multiply, *, 1)
+__define_arithmetic(primitive_subtract, -, 0)
+
+#undef __define_arithmetic
 
 /**
- * Grows a stretchy buffer.
- * 
- * @param buffer    Either a NULL pointer or a pointer to a stretchy buffer.
- * @param increment The number of new elements the buffer needs to accomodate.
- * @param item_size The number of bytes an item in the stretchy buffer takes up.
- * @return  A pointer to the newly (re)allocated stretchy buffer.
+ * (/ a b): divides two numbers, giving a fixnum when the division is exact.
  */
-static void*
-__buffer_growf(void* buffer, const unsigned int increment, size_t item_size)
+static plt_value
+primitive_divide(plt_vm* vm, const plt_value* arguments, size_t argument_count)
 {
-    size_t double_current_size = buffer ? 2 * (__buffer_size(buffer)) : 0;
-    size_t minimum_needed_size = buffer_count(buffer) + increment;
-
-    // We do this because, when the buffer is empty (i.e. NULL pointer),
-    // double_current_size is zero and minimum_needed_size is one. This also
-    // allows us to implement a stb_sb_add() macro that grows the buffer by an
-    // arbitrary increment, instead of an increment of one.
-    size_t new_size =
-        double_current_size > minimum_needed_size
-        ? double_current_size
-        : minimum_needed_size;
+    (void)argument_count;
 
-    size_t* new_buffer = reallocate(
-        buffer ? __buffer_raw(buffer) : 0,
-        item_size * new_size + sizeof(size_t) * 2);
+    if (!check_number(vm, arguments[0]) || !check_number(vm, arguments[1]))
+        return PLT_UNSPECIFIED;
 
-    if (new_buffer)
+    if ((arguments[0] & 1) && (arguments[1] & 1))
     {
-        new_buffer[0] = new_size;
+        const long long dividend = plt_fixnum_value(arguments[0]);
+        const long long divisor = plt_fixnum_value(arguments[1]);
 
-        if (!buffer)
-            new_buffer[1] = 0;
+        if (divisor == 0)
+            return plt_raise(vm, PLT_EVAL_DIVIDE_BY_ZERO, arguments[0]);
 
-        return &new_buffer[2];
+        if (dividend % divisor == 0)
+            return make_integer(vm, dividend / divisor);
     }
-    // Out of memory.
-    else return 0;
+
+    return make_flonum(
+        vm,
+        number_to_double(arguments[0]) / number_to_double(arguments[1]));
 }
 
-/// LEXING
+// Defines a primitive that takes two fixnums.
+#define __define_fixnum_operator(name, expression) \
+    static plt_value \
+    name(plt_vm* vm, const plt_value* arguments, size_t argument_count) \
+    { \
+        (void)argument_count; \
+        if (!(arguments[0] & 1)) \
+            return plt_raise(vm, PLT_EVAL_WRONG_TYPE, arguments[0]); \
+        if (!(arguments[1] & 1)) \
+            return plt_raise(vm, PLT_EVAL_WRONG_TYPE, arguments[1]); \
+        const long long a = plt_fixnum_value(arguments[0]); \
+        const long long b = plt_fixnum_value(arguments[1]); \
+        if (b == 0) \
+            return plt_raise(vm, PLT_EVAL_DIVIDE_BY_ZERO, arguments[0]); \
+        return make_integer(vm, expression); \
+    }
+
+__define_fixnum_operator(primitive_quotient, a / b)
+__define_fixnum_operator(primitive_remainder, a % b)
+
+#undef __define_fixnum_operator
+
+// Defines a primitive that compares two numbers.
+#define __define_comparison(name, operator) \
+    static plt_value \
+    name(plt_vm* vm, const plt_value* arguments, size_t argument_count) \
+    { \
+        (void)argument_count; \
+        if (!check_number(vm, arguments[0]) \
+            || !check_number(vm, arguments[1])) \
+            return PLT_UNSPECIFIED; \
+        if ((arguments[0] & arguments[1]) & 1) \
+            return plt_make_boolean( \
+                plt_fixnum_value(arguments[0]) \
+                operator plt_fixnum_value(arguments[1])); \
+        return plt_make_boolean( \
+            number_to_double(arguments[0]) \
+            operator number_to_double(arguments[1])); \
+    }
+
+__define_comparison(primitive_equal, ==)
+__define_comparison(primitive_less, <)
+__define_comparison(primitive_greater, >)
+__define_comparison(primitive_less_or_equal, <=)
+__define_comparison(primitive_greater_or_equal, >=)
+
+#undef __define_comparison
 
 /**
- * Stores Pilot Scheme's lexer state for a source string.
+ * (cons a b): makes a pair.
  */
-typedef struct plt_lexer_s {
-    // A stretchy buffer used to temporarily store the text value of a token.
-    char* buffer;
-    // Where the lexer is currently located in the source string.
-    unsigned int cursor_offset;
-} plt_lexer;
+static plt_value
+primitive_cons(plt_vm* vm, const plt_value* arguments, size_t argument_count)
+{
+    (void)argument_count;
+
+    const plt_value pair = plt_cons(vm->context, arguments[0], arguments[1]);
+
+    if (pair == PLT_EMPTY_LIST)
+        return plt_raise(vm, PLT_EVAL_OUT_OF_MEMORY, PLT_UNSPECIFIED);
+
+    return pair;
+}
 
 /**
- * Stores data on a token extracted from a source string.
+ * (car pair): the first half of a pair.
  */
-typedef struct plt_token_s {
-    // Snippet of the source code this token represents.
-    const char* text;
+static plt_value
+primitive_car(plt_vm* vm, const plt_value* arguments, size_t argument_count)
+{
+    (void)argument_count;
 
-    #define TOKEN_TYPES \
-        _(INVALID) \
-        _(LIST_START) \
-        _(LIST_END) \
-        _(QUOTE) \
-        _(NUMBER) \
-        _(IDENT) \
-        _(EOF)
+    if ((arguments[0] & PLT_TAG_MASK) != PLT_TAG_PAIR)
+        return plt_raise(vm, PLT_EVAL_WRONG_TYPE, arguments[0]);
 
-    // The type of token.
-    enum plt_token_type {
-        #define _(T) PLT_TOKEN_ ## T,
-        TOKEN_TYPES
-        #undef _
-    } type;
-} plt_token;
+    return plt_car(arguments[0]);
+}
 
 /**
- * Returns the string representation of the token type.
- * 
- * @param token_type    The type of the token.
- * @return  A string representation of the token type.
+ * (cdr pair): the second half of a pair.
  */
-const char*
-plt_token_type_to_string(enum plt_token_type token_type)
+static plt_value
+primitive_cdr(plt_vm* vm, const plt_value* arguments, size_t argument_count)
 {
-    switch (token_type)
-    {
-        #define _(T) case PLT_TOKEN_ ## T: return #T;
-        TOKEN_TYPES
-        #undef _
+    (void)argument_count;
 
-        default:
-            return "UNDEFINED";
-    }
+    if ((arguments[0] & PLT_TAG_MASK) != PLT_TAG_PAIR)
+        return plt_raise(vm, PLT_EVAL_WRONG_TYPE, arguments[0]);
+
+    return plt_cdr(arguments[0]);
 }
 
 /**
- * Retrieves the next token from the source code provided.
- * 
- * Using the given lexer for context, we grab the next token waiting in the
- * source code. If we're at the end of the source, then an invalid token is
- * returned to the caller.
- * 
- * @param   lexer   A pointer to the current lexer.
- * @param   source  A pointer to the source code we are currently lexing.
- * @param   source_length   How long the entire source code string is.
- * @return  The token extracted from the source.
+ * (null? value): whether a value is the empty list.
  */
-plt_token
-plt_next_token(
-    plt_lexer* lexer,
-    const char* source,
-    const int source_length)
+static plt_value
+primitive_is_null(plt_vm* vm, const plt_value* arguments, size_t argument_count)
 {
-    plt_token t;
-    t.text = 0;
-    t.type = PLT_TOKEN_INVALID;
-
-    while (lexer->cursor_offset < source_length)
-    {
-        #define peek() \
-            ((lexer->cursor_offset < source_length) \
-            ? source[lexer->cursor_offset] \
-            : '\0')
+    (void)vm;
+    (void)argument_count;
 
-        #define peek_next() \
-            ((lexer->cursor_offset < source_length) \
-            ? source[lexer->cursor_offset + 1] \
-            : '\0')
+    return plt_make_boolean(arguments[0] == PLT_EMPTY_LIST);
+}
 
-        #define advance() \
-            ((lexer->cursor_offset < source_length) \
-            ? buffer_append( \
-                lexer->buffer, \
-                source[lexer->cursor_offset++]) \
-            : 0)
+/**
+ * (pair? value): whether a value is a pair.
+ */
+static plt_value
+primitive_is_pair(plt_vm* vm, const plt_value* arguments, size_t argument_count)
+{
+    (void)vm;
+    (void)argument_count;
 
-        switch (peek())
-        {
-            // Skip whitespace.
-            case ' ':
-            case '\t':
-            case '\r':
-            case '\n':
-                lexer->cursor_offset++;
-                break;
+    return plt_make_boolean((arguments[0] & PLT_TAG_MASK) == PLT_TAG_PAIR);
+}
 
-            case '(':
-            {
-                advance();
+/**
+ * (eq? a b): whether two values are the same object.
+ */
+static plt_value
+primitive_is_eq(plt_vm* vm, const plt_value* arguments, size_t argument_count)
+{
+    (void)vm;
+    (void)argument_count;
 
-                t.text = lexer->buffer;
-                t.type = PLT_TOKEN_LIST_START;
-                
-                goto cleanup;
-            } break;
+    return plt_make_boolean(arguments[0] == arguments[1]);
+}
 
-            case ')':
-            {
-                advance();
+/**
+ * (not value): whether a value is false.
+ */
+static plt_value
+primitive_not(plt_vm* vm, const plt_value* arguments, size_t argument_count)
+{
+    (void)vm;
+    (void)argument_count;
 
-                t.text = lexer->buffer;
-                t.type = PLT_TOKEN_LIST_END;
+    return plt_make_boolean(arguments[0] == PLT_FALSE);
+}
 
-                goto cleanup;
-            } break;
+/**
+ * Defines a global primitive, for the built in ones or the consumer's own.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   name    The global's name.
+ * @param   function    The primitive.
+ * @param   arity   How many arguments it takes, or -1 for any number.
+ * @param   allocation  What it allocates. When in doubt,
+ *                      PLT_PRIMITIVE_ALLOCATES is always safe.
+ * @return  One if the primitive was defined, or zero if we're out of memory.
+ */
+int
+plt_define_primitive(
+    plt_vm* vm,
+    const char* name,
+    const plt_primitive function,
+    const int arity,
+    const enum plt_primitive_allocation allocation)
+{
+    size_t length = 0;
 
-            case '\'':
-            {
-                advance();
+    while (name[length])
+        length++;
 
-                t.text = lexer->buffer;
-                t.type = PLT_TOKEN_QUOTE;
+    const size_t symbol = plt_intern(vm->context, vm->symbols, name, length);
 
-                goto cleanup;
-            } break;
+    if (symbol == PLT_NO_SYMBOL || !reserve_global(vm, symbol))
+        return 0;
 
-            default:
-            {
-                #define is_digit(c) ((c) >= '0' && (c) <= '9')
+    plt_primitive_box* box = plt_allocate_headerless(
+        vm->context,
+        sizeof(plt_primitive_box),
+        PLT_VALUE_ALIGNMENT);
 
-                #define is_alphanum(c) \
-                    (is_digit(c) \
-                    || ((c) >= 'A' && (c) <= 'Z') \
-                    || ((c) >= 'a' && (c) <= 'z') \
-                    || ((c) == '_') \
-                    || ((c) == '-'))
+    if (!box)
+        return 0;
 
-                if (is_digit(peek()))
-                {
-                    // read number
-                    while (is_digit(peek()))
-                        advance();
+    box->type = PLT_VALUE_PRIMITIVE;
+    box->function = function;
+    box->arity = arity;
+    box->allocation = allocation;
 
-                    if (peek() == '.' && is_digit(peek_next()))
-                    {
-                        advance();
+    vm->globals[symbol] = (plt_value)box;
 
-                        while (is_digit(peek()))
-                            advance();
-                    }
+    return 1;
+}
 
-                    t.text = lexer->buffer;
-                    t.type = PLT_TOKEN_NUMBER;
+/**
+ * Virtual machine initialization.
+ * 
+ * Sets up the value stack and the built in primitives. Zero initialize the
+ * virtual machine first.
+ * 
+ * @param   vm  The virtual machine to initialize.
+ * @param   context The context to allocate from.
+ * @param   symbols The symbol table the code to run was read with.
+ * @param   stack_size  How many values the value stack holds.
+ * @return  One if the virtual machine is ready, or zero if out of memory.
+ */
+int
+plt_init_vm(
+    plt_vm* vm,
+    plt_context* context,
+    plt_symbol_table* symbols,
+    const size_t stack_size)
+{
+    vm->context = context;
+    vm->symbols = symbols;
+    vm->stack_size = stack_size;
+    vm->stack = plt_allocate_aligned(
+        context,
+        stack_size * sizeof(plt_value),
+        sizeof(plt_value));
 
-                    goto cleanup;
-                }
-                else
-                {
-                    // read identifier
-                    // NOTE: This will be complicated...
-                    // Because we want UTF8 support, and Lisps allow crazy
-                    // things as identifiers... we're gonna have to get a little
-                    // creative to get this to work.
+    if (!vm->stack)
+        return 0;
 
-                    // NOTE: Just a little hack for now to have identifiers.
-                    while (is_alphanum(peek()))
-                        advance();
+    const char* special_forms[] = {
+        "quote", "if", "define", "set!", "lambda", "begin", "let"
+    };
+    size_t* special_form_symbols[] = {
+        &vm->quote_symbol,
+        &vm->if_symbol,
+        &vm->define_symbol,
+        &vm->set_symbol,
+        &vm->lambda_symbol,
+        &vm->begin_symbol,
+        &vm->let_symbol,
+    };
 
-                    t.text = lexer->buffer;
-                    t.type = PLT_TOKEN_IDENT;
+    for (int i = 0; i < 7; i++)
+    {
+        size_t length = 0;
 
-                    goto cleanup;
-                }
+        while (special_forms[i][length])
+            length++;
 
-                #undef is_digit
-                #undef is_alphanum
-            } break;
-        }
+        *special_form_symbols[i] =
+            plt_intern(context, symbols, special_forms[i], length);
 
-        #undef peek
-        #undef peek_next
-        #undef advance
+        if (*special_form_symbols[i] == PLT_NO_SYMBOL)
+            return 0;
     }
 
-    // Since all paths (except whitespace, which only breaks the switch) goto
-    // cleanup, we know that whatever executes here can only execute if the
-    // while loop condition (lexer->cursor_offset < source_length) is false.
-    // When that condition is false, we have reached EOF, so we handle that
-    // scenario here.
+    const struct {
+        const char* name;
+        plt_primitive function;
+        int arity;
+        enum plt_primitive_allocation allocation;
+    } primitives[] = {
+        { "+", primitive_add, -1, PLT_PRIMITIVE_ALLOCATES },
+        { "-", primitive_subtract, -1, PLT_PRIMITIVE_ALLOCATES },
+        { "*", primitive_multiply, -1, PLT_PRIMITIVE_ALLOCATES },
+        { "/", primitive_divide, 2, PLT_PRIMITIVE_ALLOCATES },
+        { "quotient", primitive_quotient, 2, PLT_PRIMITIVE_ALLOCATES },
+        { "remainder", primitive_remainder, 2, PLT_PRIMITIVE_ALLOCATES },
+        { "=", primitive_equal, 2, PLT_PRIMITIVE_PURE },
+        { "<", primitive_less, 2, PLT_PRIMITIVE_PURE },
+        { ">", primitive_greater, 2, PLT_PRIMITIVE_PURE },
+        { "<=", primitive_less_or_equal, 2, PLT_PRIMITIVE_PURE },
+        { ">=", primitive_greater_or_equal, 2, PLT_PRIMITIVE_PURE },
+        { "cons", primitive_cons, 2, PLT_PRIMITIVE_CONSTRUCTS },
+        { "car", primitive_car, 1, PLT_PRIMITIVE_PURE },
+        { "cdr", primitive_cdr, 1, PLT_PRIMITIVE_PURE },
+        { "null?", primitive_is_null, 1, PLT_PRIMITIVE_PURE },
+        { "pair?", primitive_is_pair, 1, PLT_PRIMITIVE_PURE },
+        { "eq?", primitive_is_eq, 2, PLT_PRIMITIVE_PURE },
+        { "not", primitive_not, 1, PLT_PRIMITIVE_PURE },
+    };
 
-    t.type = PLT_TOKEN_EOF;
+    for (size_t i = 0; i < sizeof(primitives) / sizeof(*primitives); i++)
+        if (!plt_define_primitive(
+            vm,
+            primitives[i].name,
+            primitives[i].function,
+            primitives[i].arity,
+            primitives[i].allocation))
+            return 0;
 
-    cleanup:
-    buffer_reset(lexer->buffer);
+    return 1;
+}
 
-    return t;
+/**
+ * Evaluates a form: compiles it to bytecode, then runs it.
+ * 
+ * @param   vm  The virtual machine.
+ * @param   form    The form, usually from plt_read().
+ * @return  The form's value, or why there isn't one.
+ */
+plt_eval_result
+plt_eval(plt_vm* vm, const plt_value form)
+{
+    plt_prototype* prototype = 0;
+    const plt_eval_result result = plt_compile(vm, form, &prototype);
+
+    if (result.status != PLT_EVAL_OK)
+        return result;
+
+    return plt_execute(vm, prototype);
 }
 
 /// CLEANUP
@@ -477,13 +6790,40 @@ plt_next_token(
 
 // Clean up stretchy buffer defines.
 #undef buffer_append
+#undef buffer_add_n
 #undef buffer_count
 #undef buffer_reset
 #undef __buffer_raw
 #undef __buffer_size
 #undef __buffer_used
 #undef __buffer_needs_to_grow
+#undef __buffer_has_room
 #undef __buffer_grow
 #undef __buffer_maybe_grow
 
+// Clean up the allocation sites of internal allocators. The consumer's calls
+// to the public ones still note theirs.
+#ifdef PILOT_ENABLE_ALLOCATION_TRACE
+#undef allocate
+#undef reallocate
+#endif
+
+// Clean up scanning defines.
+#undef is_whitespace
+#undef is_digit
+#undef is_alphanum
+#undef sse2_in_range
+#undef sse2_whitespace_mask
+#undef sse2_digit_mask
+#undef sse2_alphanum_mask
+#undef avx2_in_range
+#undef avx2_whitespace_mask
+#undef avx2_digit_mask
+#undef avx2_alphanum_mask
+#undef neon_in_range
+#undef neon_whitespace_mask
+#undef neon_digit_mask
+#undef neon_alphanum_mask
+#undef neon_movemask
+
 #endif
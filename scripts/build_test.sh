@@ -6,6 +6,7 @@ pushd ./bin > /dev/null
 
 clang -g \
 	-std=c11 \
+	-pthread \
 	-I ../includes \
 	-o ./test \
 	../test/test.c
@@ -1,39 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "stddef.h"
 #include "stdlib.h"
 #include "stdio.h"
 #include "string.h"
 
+#define PILOT_ENABLE_FILE_MAPPING
 #include "pilot.h"
 
 #define KiB(n) (1024 * (n))
 #define MiB(n) (1024 * KiB(n))
 
+// Hands the context more memory whenever its pool runs dry, at least a
+// megabyte at a time so that big sources don't turn into lots of tiny blocks.
+static void*
+provide_block(size_t minimum_size, size_t* provided_size, void* user_data)
+{
+    (void)user_data;
+
+    *provided_size = minimum_size < MiB(1) ? MiB(1) : minimum_size;
+
+    return malloc(*provided_size);
+}
+
+static void
+release_block(void* block, size_t size, void* user_data)
+{
+    (void)size;
+    (void)user_data;
+
+    free(block);
+}
+
 int
-main(void)
+main(int argc, char** argv)
 {
+    const char* source = "(cons 1 2)";
+    size_t source_length = strlen(source);
+
+    // Lex the file named on the command line, if there is one, straight out
+    // of its mapping.
+    plt_mapped_file file = { 0 };
+
+    if (argc > 1)
+    {
+        if (!plt_map_file(argv[1], &file))
+        {
+            fprintf(stderr, "Unable to open %s!\n", argv[1]);
+            return 1;
+        }
+
+        source = file.data;
+        source_length = file.length;
+    }
+
+    // Start with a modest pool and let the provider chain on more blocks if
+    // the source turns out to need them.
     const size_t memory_pool_size = MiB(1);
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+    plt_set_block_provider(&context, provide_block, release_block, 0);
 
-    plt_lexer lexer = { 0 };
-    plt_token token = { 0 };
+    const plt_arena_mark start = plt_mark(&context);
 
-    const char* source = "(cons 1 2)";
-    size_t source_length = strlen(source);
+    plt_token_stream tokens = { 0 };
 
-    while ((token = plt_next_token(
-        &lexer,
-        source,
-        source_length)).type != PLT_TOKEN_INVALID)
+    if (!plt_tokenize(&context, source, source_length, &tokens))
+    {
+        fprintf(stderr, "Out of memory!\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < tokens.count; i++)
     {
         printf(
-            "[%s]\t%s\n",
-            plt_token_type_to_string(token.type),
-            token.text);
+            "[%s]\t%.*s\n",
+            plt_token_type_to_string(tokens.types[i]),
+            (int)tokens.lengths[i],
+            source + tokens.offsets[i]);
     }
 
-    
+    // Hands every chained block back to the provider.
+    plt_rewind(&context, start);
+
+    plt_unmap_file(&file);
+    free(memory_pool);
+
     return 0;
-}
\ No newline at end of file
+}
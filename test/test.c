@@ -1,29 +1,43 @@
+// Needed for the file mapping functions on POSIX systems.
+#define _POSIX_C_SOURCE 200809L
+
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
 
+// Tests that run out of memory on purpose set this, so they don't flood the
+// output.
+static int is_running_out_of_memory = 0;
+
 // NOTE: Small hack to get the test code to stop throwing warnings.
 // I forgot that the values passed to this macro are size_t, which changes
 // depending on architecture. Unlike my tower, which uses 64-bit Intel, my
 // shiny new PineBook uses a 64-bit ARM processor.
 #ifdef __aarch64__
 #define PLT_OUT_OF_MEMORY(demanded_size, given_size) \
-    printf( \
+    (is_running_out_of_memory ? 0 : printf( \
         "Insufficient memory!\n" \
         "Required:\t%ld bytes\n" \
         "Given:\t%ld bytes\n", \
         demanded_size, \
-        given_size)
+        given_size))
 #else
 #define PLT_OUT_OF_MEMORY(demanded_size, given_size) \
-    printf( \
+    (is_running_out_of_memory ? 0 : printf( \
         "Insufficient memory!\n" \
         "Required:\t%lld bytes\n" \
         "Given:\t%lld bytes\n", \
         demanded_size, \
-        given_size)
+        given_size))
 #endif
 
+#define PILOT_ENABLE_FILE_MAPPING
+#define PILOT_ENABLE_THREADS
+// Split even tiny test sources across threads.
+#define PILOT_MIN_PARALLEL_CHUNK 16
+#define PILOT_ENABLE_ALLOCATION_TRACE
+// Small enough for a test to wrap around.
+#define PILOT_ALLOCATION_TRACE_LENGTH 8
 #include "pilot.h"
 
 #include "utest.h"
@@ -34,10 +48,12 @@ UTEST(basic, first_token_invalid_for_empty_input)
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
 
     plt_lexer lexer = { 0 };
     plt_token token = plt_next_token(
+        &context,
         &lexer,
         "",
         0);
@@ -47,161 +63,2563 @@ UTEST(basic, first_token_invalid_for_empty_input)
     free(memory_pool);
 }
 
-UTEST(lexing, identifies_open_paren)
+UTEST(basic, contexts_do_not_share_arenas)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool_a = malloc(memory_pool_size);
+    void* memory_pool_b = malloc(memory_pool_size);
+    memset(memory_pool_a, 0, memory_pool_size);
+    memset(memory_pool_b, 0, memory_pool_size);
+
+    plt_context context_a = { 0 };
+    plt_context context_b = { 0 };
+    plt_init(&context_a, memory_pool_a, memory_pool_size);
+    plt_init(&context_b, memory_pool_b, memory_pool_size);
+
+    const char* source = "first second";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer_a = { 0 };
+    plt_lexer lexer_b = { 0 };
+
+    plt_token a = plt_next_token(&context_a, &lexer_a, source, source_length);
+    plt_token b = plt_next_token(&context_b, &lexer_b, source, source_length);
+
+    // Each token's text lives in its own context's arena.
+    EXPECT_TRUE((char*)a.text >= (char*)memory_pool_a);
+    EXPECT_TRUE((char*)a.text < (char*)memory_pool_a + memory_pool_size);
+    EXPECT_TRUE((char*)b.text >= (char*)memory_pool_b);
+    EXPECT_TRUE((char*)b.text < (char*)memory_pool_b + memory_pool_size);
+
+    EXPECT_STREQ("first", a.text);
+    EXPECT_STREQ("first", b.text);
+
+    free(memory_pool_a);
+    free(memory_pool_b);
+}
+
+UTEST(basic, shared_arena_hands_out_slabs)
 {
     const size_t memory_pool_size = 1024;
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_shared_arena shared = { 0 };
+    plt_init_shared(&shared, memory_pool, memory_pool_size);
+
+    plt_context context_a = { 0 };
+    plt_context context_b = { 0 };
+    plt_init_from_shared(&context_a, &shared, 256);
+    plt_init_from_shared(&context_b, &shared, 256);
 
+    const char* source = "shared";
     plt_lexer lexer = { 0 };
-    plt_token token = plt_next_token(
+    plt_token_slice slice = plt_next_token_slice(
         &lexer,
-        "(",
-        1);
+        source,
+        strlen(source));
 
-    EXPECT_EQ(PLT_TOKEN_LIST_START, token.type);
+    char* a = plt_token_slice_to_string(&context_a, slice, source);
+    char* b = plt_token_slice_to_string(&context_b, slice, source);
+
+    ASSERT_TRUE(a != 0);
+    ASSERT_TRUE(b != 0);
+    EXPECT_STREQ("shared", a);
+    EXPECT_STREQ("shared", b);
+
+    // Each context took a slab of its own.
+    EXPECT_EQ(512u, shared.used_length);
+    EXPECT_TRUE(b - a >= 256 || a - b >= 256);
+
+    // Two more slabs use the pool up, after which allocations fail.
+    plt_context context_c = { 0 };
+    plt_init_from_shared(&context_c, &shared, 512);
+
+    EXPECT_TRUE(plt_token_slice_to_string(&context_c, slice, source) != 0);
+    EXPECT_TRUE(plt_token_slice_to_string(&context_a, slice, source) != 0);
+
+    plt_context context_d = { 0 };
+    plt_init_from_shared(&context_d, &shared, 256);
+
+    EXPECT_TRUE(plt_token_slice_to_string(&context_d, slice, source) == 0);
 
     free(memory_pool);
 }
 
-UTEST(lexing, identifies_close_paren)
+#if !defined(_WIN32)
+
+typedef struct shared_arena_worker_s {
+    plt_shared_arena* shared;
+    int failures;
+} shared_arena_worker;
+
+static void*
+allocate_from_shared_arena(void* argument)
+{
+    shared_arena_worker* worker = argument;
+
+    plt_context context = { 0 };
+    plt_init_from_shared(&context, worker->shared, 1024);
+
+    const char* source = "(worker threads allocate strings)";
+    const size_t source_length = strlen(source);
+
+    for (int i = 0; i < 200; i++)
+    {
+        plt_lexer lexer = { 0 };
+        plt_token_slice slice;
+
+        while ((slice = plt_next_token_slice(
+            &lexer,
+            source,
+            source_length)).type != PLT_TOKEN_EOF)
+        {
+            char* text = plt_token_slice_to_string(&context, slice, source);
+
+            if (!text
+                || strlen(text) != slice.length
+                || strncmp(text, source + slice.offset, slice.length) != 0)
+            {
+                worker->failures++;
+            }
+        }
+    }
+
+    return 0;
+}
+
+UTEST(basic, shared_arena_is_safe_across_threads)
+{
+    const size_t memory_pool_size = 1024 * 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_shared_arena shared = { 0 };
+    plt_init_shared(&shared, memory_pool, memory_pool_size);
+
+    pthread_t threads[4];
+    shared_arena_worker workers[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        workers[i].shared = &shared;
+        workers[i].failures = 0;
+        pthread_create(
+            &threads[i],
+            0,
+            allocate_from_shared_arena,
+            &workers[i]);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], 0);
+        EXPECT_EQ(0, workers[i].failures);
+    }
+
+    free(memory_pool);
+}
+
+#endif
+
+UTEST(memory, rewinding_frees_everything_after_the_mark)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const char* source = "(lots of tokens to lex and throw away)";
+    const size_t source_length = strlen(source);
+
+    plt_arena_mark mark = plt_mark(&context);
+
+    plt_token_stream first = { 0 };
+    ASSERT_NE(0u, plt_tokenize(&context, source, source_length, &first));
+    EXPECT_TRUE(context.arena_cursor != mark.arena_cursor);
+
+    plt_rewind(&context, mark);
+    EXPECT_TRUE(context.arena_cursor == mark.arena_cursor);
+
+    // The same memory gets handed out again, so the pool never fills up.
+    for (int i = 0; i < 100; i++)
+    {
+        plt_temporary_memory temporary = plt_begin_temporary_memory(&context);
+
+        plt_token_stream stream = { 0 };
+        ASSERT_NE(0u, plt_tokenize(&context, source, source_length, &stream));
+        EXPECT_TRUE(stream.types == first.types);
+
+        plt_end_temporary_memory(temporary);
+    }
+
+    EXPECT_TRUE(context.arena_cursor == mark.arena_cursor);
+
+    free(memory_pool);
+}
+
+UTEST(memory, temporary_memory_nests)
 {
     const size_t memory_pool_size = 1024;
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
 
+    const char* source = "kept";
     plt_lexer lexer = { 0 };
-    plt_token token = plt_next_token(
+    plt_token_slice slice = plt_next_token_slice(
         &lexer,
-        ")",
-        1);
+        source,
+        strlen(source));
 
-    EXPECT_EQ(PLT_TOKEN_LIST_END, token.type);
+    plt_temporary_memory outer = plt_begin_temporary_memory(&context);
+    char* kept = plt_token_slice_to_string(&context, slice, source);
+
+    plt_temporary_memory inner = plt_begin_temporary_memory(&context);
+    char* dropped = plt_token_slice_to_string(&context, slice, source);
+    plt_end_temporary_memory(inner);
+
+    // The inner scope's memory is reused, while the outer scope's survives.
+    char* reused = plt_token_slice_to_string(&context, slice, source);
+    EXPECT_TRUE(reused == dropped);
+    EXPECT_STREQ("kept", kept);
+
+    plt_end_temporary_memory(outer);
+    EXPECT_TRUE(context.arena_cursor == context.arena);
 
     free(memory_pool);
 }
 
-UTEST(lexing, identifies_quote)
+UTEST(memory, rewinding_gives_back_the_latest_shared_slab)
 {
     const size_t memory_pool_size = 1024;
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_shared_arena shared = { 0 };
+    plt_init_shared(&shared, memory_pool, memory_pool_size);
 
+    plt_context context = { 0 };
+    plt_init_from_shared(&context, &shared, 128);
+
+    const char* source = "slab_sized_source_text";
     plt_lexer lexer = { 0 };
-    plt_token token = plt_next_token(&lexer, "\'", 1);
+    plt_token_slice slice = plt_next_token_slice(
+        &lexer,
+        source,
+        strlen(source));
 
-    EXPECT_EQ(PLT_TOKEN_QUOTE, token.type);
+    ASSERT_TRUE(plt_token_slice_to_string(&context, slice, source) != 0);
+    EXPECT_EQ(128u, shared.used_length);
+
+    plt_arena_mark mark = plt_mark(&context);
+
+    // Each string takes 32 bytes once padded, so four of them fill the first
+    // slab and the last one here makes the context take a second one.
+    for (int i = 0; i < 4; i++)
+        ASSERT_TRUE(plt_token_slice_to_string(&context, slice, source) != 0);
+
+    EXPECT_EQ(256u, shared.used_length);
+
+    plt_rewind(&context, mark);
+    EXPECT_EQ(128u, shared.used_length);
 
     free(memory_pool);
 }
 
-UTEST(lexing, identifies_number)
+UTEST(memory, buffers_at_the_end_of_the_arena_grow_in_place)
 {
     const size_t memory_pool_size = 1024;
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    // Copying the lexer's buffer on every doubling would need well over 1KiB
+    // for this token. Growing in place needs a little over 900 bytes.
+    char source[900];
+    memset(source, 'x', sizeof(source));
 
     plt_lexer lexer = { 0 };
-    plt_token token = plt_next_token(&lexer, "0", 1);
+    plt_token token = plt_next_token(&context, &lexer, source, sizeof(source));
 
-    EXPECT_EQ(PLT_TOKEN_NUMBER, token.type);
+    EXPECT_EQ(PLT_TOKEN_IDENT, token.type);
+    ASSERT_TRUE(token.text != 0);
+    EXPECT_EQ(sizeof(source), strlen(token.text));
 
     free(memory_pool);
 }
 
-UTEST(lexing, identifies_ident)
+UTEST(memory, aligned_allocations_are_aligned)
 {
     const size_t memory_pool_size = 1024;
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
 
-    const char* string = "cons";
-    const size_t string_length = strlen(string);
+    const size_t alignments[] = { 1, 8, 16, 32, 64 };
+
+    for (int i = 0; i < 5; i++)
+    {
+        // Knock the cursor off alignment first.
+        ASSERT_TRUE(plt_allocate_headerless(&context, 3, 1) != 0);
+
+        void* aligned = plt_allocate_aligned(&context, 24, alignments[i]);
+        ASSERT_TRUE(aligned != 0);
+        EXPECT_EQ(0u, (size_t)aligned % alignments[i]);
+        EXPECT_EQ(0u, (size_t)aligned % sizeof(size_t));
+
+        void* headerless =
+            plt_allocate_headerless(&context, 24, alignments[i]);
+        ASSERT_TRUE(headerless != 0);
+        EXPECT_EQ(0u, (size_t)headerless % alignments[i]);
+    }
+
+    free(memory_pool);
+}
+
+UTEST(memory, headerless_allocations_have_no_header)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    char* first = plt_allocate_headerless(&context, 16, 16);
+    char* second = plt_allocate_headerless(&context, 16, 16);
+
+    ASSERT_TRUE(first != 0);
+    EXPECT_TRUE(second == first + 16);
+
+    // An exact fit still succeeds, and one byte more fails.
+    const size_t used_length =
+        (size_t)context.arena_cursor - (size_t)context.arena;
+    const size_t remaining = memory_pool_size - used_length;
+
+    EXPECT_TRUE(plt_allocate_headerless(&context, remaining + 1, 1) == 0);
+    EXPECT_TRUE(plt_allocate_headerless(&context, remaining, 1) != 0);
+
+    free(memory_pool);
+}
+
+// Counts the blocks a context is holding onto, so tests can check that they
+// all come back.
+static void*
+provide_counted_block(size_t minimum_size, size_t* provided_size, void* live)
+{
+    *provided_size = minimum_size < 256 ? 256 : minimum_size;
+    (*(int*)live)++;
+
+    return malloc(*provided_size);
+}
+
+static void
+release_counted_block(void* block, size_t size, void* live)
+{
+    (void)size;
+    (*(int*)live)--;
+
+    free(block);
+}
+
+UTEST(memory, providers_chain_on_blocks_until_rewound)
+{
+    const size_t memory_pool_size = 256;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    int live = 0;
+    plt_set_block_provider(
+        &context,
+        provide_counted_block,
+        release_counted_block,
+        &live);
+
+    const plt_arena_mark start = plt_mark(&context);
+
+    // Far more tokens than the pool alone can hold.
+    char source[2048];
+    for (size_t i = 0; i < sizeof(source); i += 2)
+    {
+        source[i] = '(';
+        source[i + 1] = ' ';
+    }
+
+    plt_token_stream stream = { 0 };
+    const size_t count =
+        plt_tokenize(&context, source, sizeof(source), &stream);
+
+    ASSERT_EQ(sizeof(source) / 2 + 1, count);
+    EXPECT_EQ(PLT_TOKEN_LIST_START, stream.types[count - 2]);
+    EXPECT_EQ(sizeof(source) - 2, stream.offsets[count - 2]);
+    EXPECT_TRUE(live > 0);
+
+    plt_rewind(&context, start);
+
+    EXPECT_EQ(0, live);
+    EXPECT_TRUE(context.arena == memory_pool);
+    EXPECT_TRUE(plt_allocate_headerless(&context, 16, 16) != 0);
+
+    free(memory_pool);
+}
+
+UTEST(memory, tokens_too_big_for_the_arena_have_no_text)
+{
+    const size_t memory_pool_size = 64;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const plt_arena_mark start = plt_mark(&context);
+
+    char source[256];
+    memset(source, 'x', sizeof(source));
 
     plt_lexer lexer = { 0 };
-    plt_token token = plt_next_token(
-        &lexer,
-        string,
-        string_length);
+    plt_token token = plt_next_token(&context, &lexer, source, sizeof(source));
 
     EXPECT_EQ(PLT_TOKEN_IDENT, token.type);
+    EXPECT_TRUE(token.text == 0);
+
+    // Once the half-built buffer is thrown away, a token that fits comes back
+    // whole.
+    plt_rewind(&context, start);
+
+    plt_lexer next_lexer = { 0 };
+    token = plt_next_token(&context, &next_lexer, "(", 1);
+
+    EXPECT_EQ(PLT_TOKEN_LIST_START, token.type);
+    ASSERT_TRUE(token.text != 0);
+    EXPECT_EQ(0, strcmp("(", token.text));
 
     free(memory_pool);
 }
 
-UTEST(lexing, correctly_identifies_consecutive_tokens)
+UTEST(memory, chunked_tokens_that_run_out_of_memory_have_no_text)
 {
-    const size_t memory_pool_size = 1024;
+    const size_t memory_pool_size = 128;
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
 
-    const char* source = "(cons";
+    char middle[256];
+    memset(middle, 'x', sizeof(middle));
 
     plt_lexer lexer = { 0 };
 
-    // Extract first token (paren)
-    plt_token paren = plt_next_token(
-        &lexer,
-        source,
-        strlen(source));
+    // Leave the buffer with room to spare for the end of the next token.
+    plt_token t = plt_next_token_chunk(&context, &lexer, "abcdefghijkl ", 13);
+    ASSERT_TRUE(t.text != 0);
+    EXPECT_STREQ("abcdefghijkl", t.text);
 
-    EXPECT_EQ(PLT_TOKEN_LIST_START, paren.type);
-    EXPECT_STREQ("(", paren.text);
+    t = plt_next_token_chunk(&context, &lexer, "abcdefghijkl ", 13);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
 
-    // Extract second token (identifier)
-    plt_token ident = plt_next_token(
-        &lexer,
-        source,
-        strlen(source));
+    t = plt_next_token_chunk(&context, &lexer, "ab", 2);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
 
-    EXPECT_EQ(PLT_TOKEN_IDENT, ident.type);
-    EXPECT_STREQ("cons", ident.text);
+    // The middle of the token doesn't fit, but its end would.
+    is_running_out_of_memory = 1;
+    t = plt_next_token_chunk(&context, &lexer, middle, sizeof(middle));
+    is_running_out_of_memory = 0;
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
+
+    t = plt_next_token_chunk(&context, &lexer, "cd) ", 4);
+    EXPECT_EQ(PLT_TOKEN_IDENT, t.type);
+    EXPECT_TRUE(t.text == 0);
+    EXPECT_EQ(PLT_NO_SYMBOL, t.symbol);
+
+    // The next token starts over with all of its text.
+    t = plt_next_token_chunk(&context, &lexer, "cd) ", 4);
+    EXPECT_EQ(PLT_TOKEN_LIST_END, t.type);
+    ASSERT_TRUE(t.text != 0);
+    EXPECT_STREQ(")", t.text);
+
+    // Running out of memory is remembered until the end of the input, too.
+    t = plt_next_token_chunk(&context, &lexer, "cd) ", 4);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
+
+    t = plt_next_token_chunk(&context, &lexer, "ab", 2);
+    is_running_out_of_memory = 1;
+    t = plt_next_token_chunk(&context, &lexer, middle, sizeof(middle));
+    is_running_out_of_memory = 0;
+    t = plt_next_token_chunk(&context, &lexer, "c", 1);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
+
+    t = plt_next_token_chunk(&context, &lexer, "", 0);
+    EXPECT_EQ(PLT_TOKEN_IDENT, t.type);
+    EXPECT_TRUE(t.text == 0);
 
     free(memory_pool);
 }
 
-UTEST(lexing, separates_two_whitespace_adjacent_numbers)
+UTEST(memory, pools_reuse_freed_objects)
 {
     const size_t memory_pool_size = 1024;
     void* memory_pool = malloc(memory_pool_size);
     memset(memory_pool, 0, memory_pool_size);
 
-    plt_init(memory_pool, memory_pool_size);
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
 
-    const char* source = "1 2";
-    const size_t source_length = strlen(source);
+    // Objects of a size class come out of the arena side by side.
+    char* first = plt_pool_allocate(&context, PLT_POOL_GRANULE);
+    char* second = plt_pool_allocate(&context, PLT_POOL_GRANULE);
+
+    ASSERT_TRUE(first != 0);
+    EXPECT_EQ(0u, (size_t)first % PLT_POOL_GRANULE);
+    EXPECT_TRUE(second == first + PLT_POOL_GRANULE);
+
+    // The last object freed is the next one handed out, for any size in its
+    // class.
+    plt_pool_free(&context, first, PLT_POOL_GRANULE);
+    EXPECT_TRUE(plt_pool_allocate(&context, 1) == first);
+
+    // Other size classes don't share objects.
+    plt_pool_free(&context, second, PLT_POOL_GRANULE);
+    char* bigger = plt_pool_allocate(&context, PLT_POOL_GRANULE + 1);
+
+    ASSERT_TRUE(bigger != 0);
+    EXPECT_TRUE(bigger != second);
+    EXPECT_EQ(0u, (size_t)bigger % PLT_POOL_GRANULE);
+
+    // Churning through a size class doesn't use up the arena.
+    const void* cursor = context.arena_cursor;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        void* object = plt_pool_allocate(&context, PLT_POOL_GRANULE);
+        ASSERT_TRUE(object != 0);
+        plt_pool_free(&context, object, PLT_POOL_GRANULE);
+    }
+
+    EXPECT_TRUE(context.arena_cursor == cursor);
+
+    free(memory_pool);
+}
+
+UTEST(memory, rewinding_empties_the_pools)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const plt_arena_mark start = plt_mark(&context);
+
+    void* object = plt_pool_allocate(&context, 24);
+    ASSERT_TRUE(object != 0);
+    plt_pool_free(&context, object, 24);
+
+    plt_rewind(&context, start);
+
+    for (int i = 0; i < PILOT_POOL_CLASS_COUNT; i++)
+        EXPECT_TRUE(context.pool_free_lists[i] == 0);
+
+    // The arena is reused from the mark instead.
+    EXPECT_TRUE(plt_pool_allocate(&context, 24) == object);
+
+    free(memory_pool);
+}
+
+UTEST(memory, rewinding_keeps_objects_freed_from_before_the_mark)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    void* older = plt_pool_allocate(&context, 24);
+    ASSERT_TRUE(older != 0);
+
+    const plt_arena_mark start = plt_mark(&context);
+
+    // Freed after the mark, but allocated before it.
+    plt_pool_free(&context, older, 24);
+
+    void* newer = plt_pool_allocate(&context, 40);
+    ASSERT_TRUE(newer != 0);
+    plt_pool_free(&context, newer, 40);
+
+    plt_rewind(&context, start);
+
+    // Nothing from the newer object's batch is left to be handed out.
+    for (int i = 0; i < PILOT_POOL_CLASS_COUNT; i++)
+        for (void* o = context.pool_free_lists[i]; o; o = *(void**)o)
+            EXPECT_TRUE((char*)o < (char*)start.arena_cursor);
+
+    // The older object is still there to be reused.
+    EXPECT_TRUE(plt_pool_allocate(&context, 24) == older);
+
+    free(memory_pool);
+}
+
+UTEST(memory, stats_track_use_and_stranded_bytes)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const plt_arena_mark start = plt_mark(&context);
+
+    ASSERT_TRUE(plt_allocate_headerless(&context, 16, 1) != 0);
 
+    plt_arena_stats stats = plt_get_arena_stats(&context);
+    EXPECT_EQ(16u, stats.used_length);
+    EXPECT_EQ(1u, stats.allocation_count);
+    EXPECT_EQ(0u, stats.stranded_length);
+
+    // Pin the lexer's buffer behind another allocation, so that a longer
+    // token has to copy it somewhere else.
     plt_lexer lexer = { 0 };
+    const char* source = "short much_longer_identifier";
 
-    // Extract first number
-    plt_token number1 = plt_next_token(
-        &lexer,
-        source,
-        source_length);
+    plt_next_token(&context, &lexer, source, strlen(source));
+    ASSERT_TRUE(plt_allocate_headerless(&context, 16, 1) != 0);
+    plt_next_token(&context, &lexer, source, strlen(source));
 
-    EXPECT_EQ(PLT_TOKEN_NUMBER, number1.type);
+    stats = plt_get_arena_stats(&context);
+    EXPECT_TRUE(stats.stranded_length > 0);
+    EXPECT_EQ(
+        (size_t)context.arena_cursor - (size_t)context.arena,
+        stats.used_length);
 
-    // Extract second number
-    plt_token number2 = plt_next_token(
-        &lexer,
-        source,
-        source_length);
+    // Rewinding gives the bytes back, but not the peak.
+    const size_t peak_length = stats.peak_length;
+    plt_rewind(&context, start);
 
-    EXPECT_EQ(PLT_TOKEN_NUMBER, number2.type);
+    stats = plt_get_arena_stats(&context);
+    EXPECT_EQ(0u, stats.used_length);
+    EXPECT_EQ(0u, stats.stranded_length);
+    EXPECT_EQ(peak_length, stats.peak_length);
+
+    free(memory_pool);
+}
+
+UTEST(memory, trace_keeps_the_latest_allocations)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    EXPECT_TRUE(plt_set_allocation_tag(&context, "first") == 0);
+    ASSERT_TRUE(plt_allocate_headerless(&context, 1, 1) != 0);
+
+    EXPECT_STREQ("first", plt_set_allocation_tag(&context, "rest"));
+
+    for (size_t i = 2; i <= PILOT_ALLOCATION_TRACE_LENGTH + 2; i++)
+        ASSERT_TRUE(plt_allocate_headerless(&context, i, 1) != 0);
+
+    // Only the latest allocations are left, oldest first.
+    plt_allocation_record records[PILOT_ALLOCATION_TRACE_LENGTH + 2];
+    const size_t count = plt_read_allocation_trace(
+        &context,
+        records,
+        PILOT_ALLOCATION_TRACE_LENGTH + 2);
+
+    ASSERT_EQ((size_t)PILOT_ALLOCATION_TRACE_LENGTH, count);
+    EXPECT_EQ(3u, records[0].size);
+    EXPECT_EQ(1u + 2, records[0].offset);
+    EXPECT_STREQ("rest", records[0].tag);
+    EXPECT_EQ(PILOT_ALLOCATION_TRACE_LENGTH + 2u, records[count - 1].size);
+
+    // Asking for fewer keeps the newest.
+    EXPECT_EQ(1u, plt_read_allocation_trace(&context, records, 1));
+    EXPECT_EQ(PILOT_ALLOCATION_TRACE_LENGTH + 2u, records[0].size);
 
     free(memory_pool);
 }
 
+UTEST(memory, trace_records_call_sites_and_blocks)
+{
+    const size_t memory_pool_size = 256;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    int live = 0;
+    plt_set_block_provider(
+        &context,
+        provide_counted_block,
+        release_counted_block,
+        &live);
+
+    const plt_arena_mark start = plt_mark(&context);
+
+    plt_allocation_record record;
+
+    // Our own allocations are put down to the line that asked for them.
+    const int line = __LINE__ + 1;
+    char* first = plt_allocate_headerless(&context, 16, 8);
+    ASSERT_TRUE(first != 0);
+
+    ASSERT_EQ(1u, plt_read_allocation_trace(&context, &record, 1));
+    ASSERT_TRUE(record.file != 0);
+    EXPECT_TRUE(strstr(record.file, "test.c") != 0);
+    EXPECT_EQ(line, record.line);
+    EXPECT_TRUE(record.base == memory_pool);
+    EXPECT_TRUE((char*)record.base + record.offset == first);
+
+    // And Pilot's own allocations to the line inside Pilot that made them,
+    // even when they grow a buffer.
+    plt_symbol_table symbols = { 0 };
+    ASSERT_NE(PLT_NO_SYMBOL, plt_intern(&context, &symbols, "abc", 3));
+
+    ASSERT_EQ(1u, plt_read_allocation_trace(&context, &record, 1));
+    ASSERT_TRUE(record.file != 0);
+    EXPECT_TRUE(strstr(record.file, "pilot.h") != 0);
+    EXPECT_TRUE(record.line > 0);
+
+    // Allocations past the pool come from a block, which the record says.
+    char* spilled = plt_allocate_headerless(&context, 512, 8);
+    ASSERT_TRUE(spilled != 0);
+
+    ASSERT_EQ(1u, plt_read_allocation_trace(&context, &record, 1));
+    EXPECT_TRUE(record.base != memory_pool);
+    EXPECT_TRUE(record.base == context.blocks);
+    EXPECT_TRUE((char*)record.base + record.offset == spilled);
+
+    plt_rewind(&context, start);
+    EXPECT_EQ(0, live);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, identifies_open_paren)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_lexer lexer = { 0 };
+    plt_token token = plt_next_token(
+        &context,
+        &lexer,
+        "(",
+        1);
+
+    EXPECT_EQ(PLT_TOKEN_LIST_START, token.type);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, identifies_close_paren)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_lexer lexer = { 0 };
+    plt_token token = plt_next_token(
+        &context,
+        &lexer,
+        ")",
+        1);
+
+    EXPECT_EQ(PLT_TOKEN_LIST_END, token.type);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, identifies_quote)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_lexer lexer = { 0 };
+    plt_token token = plt_next_token(&context, &lexer, "\'", 1);
+
+    EXPECT_EQ(PLT_TOKEN_QUOTE, token.type);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, identifies_number)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_lexer lexer = { 0 };
+    plt_token token = plt_next_token(&context, &lexer, "0", 1);
+
+    EXPECT_EQ(PLT_TOKEN_NUMBER, token.type);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, identifies_ident)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const char* string = "cons";
+    const size_t string_length = strlen(string);
+
+    plt_lexer lexer = { 0 };
+    plt_token token = plt_next_token(
+        &context,
+        &lexer,
+        string,
+        string_length);
+
+    EXPECT_EQ(PLT_TOKEN_IDENT, token.type);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, correctly_identifies_consecutive_tokens)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const char* source = "(cons";
+
+    plt_lexer lexer = { 0 };
+
+    // Extract first token (paren)
+    plt_token paren = plt_next_token(
+        &context,
+        &lexer,
+        source,
+        strlen(source));
+
+    EXPECT_EQ(PLT_TOKEN_LIST_START, paren.type);
+    EXPECT_STREQ("(", paren.text);
+
+    // Extract second token (identifier)
+    plt_token ident = plt_next_token(
+        &context,
+        &lexer,
+        source,
+        strlen(source));
+
+    EXPECT_EQ(PLT_TOKEN_IDENT, ident.type);
+    EXPECT_STREQ("cons", ident.text);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, separates_two_whitespace_adjacent_numbers)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const char* source = "1 2";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+
+    // Extract first number
+    plt_token number1 = plt_next_token(
+        &context,
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_NUMBER, number1.type);
+
+    // Extract second number
+    plt_token number2 = plt_next_token(
+        &context,
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_NUMBER, number2.type);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, slices_reference_the_source)
+{
+    const char* source = "(cons 12)";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+
+    plt_token_slice paren = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_LIST_START, paren.type);
+    EXPECT_EQ(0u, paren.offset);
+    EXPECT_EQ(1u, paren.length);
+
+    plt_token_slice ident = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_IDENT, ident.type);
+    EXPECT_EQ(1u, ident.offset);
+    EXPECT_EQ(4u, ident.length);
+
+    plt_token_slice number = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_NUMBER, number.type);
+    EXPECT_EQ(6u, number.offset);
+    EXPECT_EQ(2u, number.length);
+
+    // Slicing never touches the lexer's buffer.
+    EXPECT_TRUE(lexer.buffer == 0);
+}
+
+UTEST(lexing, slice_converts_to_string_on_request)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const char* source = "  cons";
+
+    plt_lexer lexer = { 0 };
+    plt_token_slice slice = plt_next_token_slice(
+        &lexer,
+        source,
+        strlen(source));
+
+    EXPECT_STREQ("cons", plt_token_slice_to_string(&context, slice, source));
+
+    free(memory_pool);
+}
+
+UTEST(lexing, scans_long_whitespace_and_identifier_runs)
+{
+    // Long enough runs that the vectorized scanners take several full steps
+    // and then finish each run partway through a vector.
+    const char* source =
+        "                                        \t\r\n  "
+        "an_identifier-that-is-longer-than-32-bytes_XYZ"
+        "\n\n\n                      "
+        "1234567890123456789012345678901234567.00000000001234567890"
+        ")";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+
+    plt_token_slice ident = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_IDENT, ident.type);
+    EXPECT_EQ(45u, ident.offset);
+    EXPECT_EQ(46u, ident.length);
+
+    plt_token_slice number = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_NUMBER, number.type);
+    EXPECT_EQ(116u, number.offset);
+    EXPECT_EQ(58u, number.length);
+
+    plt_token_slice paren = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_LIST_END, paren.type);
+    EXPECT_EQ(174u, paren.offset);
+
+    plt_token_slice eof = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_EOF, eof.type);
+}
+
+UTEST(lexing, scans_runs_of_every_length)
+{
+    // Every run length up to past two AVX2 vectors, so that each run ends at
+    // every position within a vector, including the end of the source.
+    char source[256];
+
+    for (size_t length = 1; length <= 70; length++)
+    {
+        memset(source, ' ', length);
+        memset(source + length, 'a', length);
+        source[2 * length] = ' ';
+        memset(source + 2 * length + 1, '7', length);
+
+        const size_t source_length = 3 * length + 1;
+
+        plt_lexer lexer = { 0 };
+
+        plt_token_slice ident = plt_next_token_slice(
+            &lexer,
+            source,
+            source_length);
+
+        EXPECT_EQ(PLT_TOKEN_IDENT, ident.type);
+        EXPECT_EQ(length, ident.offset);
+        EXPECT_EQ(length, ident.length);
+
+        plt_token_slice number = plt_next_token_slice(
+            &lexer,
+            source,
+            source_length);
+
+        EXPECT_EQ(PLT_TOKEN_NUMBER, number.type);
+        EXPECT_EQ(2 * length + 1, number.offset);
+        EXPECT_EQ(length, number.length);
+
+        EXPECT_EQ(
+            PLT_TOKEN_EOF,
+            plt_next_token_slice(&lexer, source, source_length).type);
+    }
+}
+
+UTEST(lexing, identifies_symbolic_identifiers)
+{
+    const char* source = "(<= a+ *b)";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+
+    const char* expected[] = { "(", "<=", "a+", "*b", ")" };
+    const enum plt_token_type expected_types[] = {
+        PLT_TOKEN_LIST_START,
+        PLT_TOKEN_IDENT,
+        PLT_TOKEN_IDENT,
+        PLT_TOKEN_IDENT,
+        PLT_TOKEN_LIST_END
+    };
+
+    for (int i = 0; i < 5; i++)
+    {
+        plt_token_slice slice = plt_next_token_slice(
+            &lexer,
+            source,
+            source_length);
+
+        EXPECT_EQ(expected_types[i], slice.type);
+        EXPECT_EQ(strlen(expected[i]), slice.length);
+        EXPECT_EQ(0, strncmp(expected[i], source + slice.offset, slice.length));
+    }
+
+    EXPECT_EQ(
+        PLT_TOKEN_EOF,
+        plt_next_token_slice(&lexer, source, source_length).type);
+}
+
+UTEST(lexing, always_consumes_unknown_bytes)
+{
+    const char* source = "\"#";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+
+    plt_token_slice quote = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_UNKNOWN, quote.type);
+    EXPECT_EQ(1u, quote.length);
+
+    plt_token_slice hash = plt_next_token_slice(
+        &lexer,
+        source,
+        source_length);
+
+    EXPECT_EQ(PLT_TOKEN_UNKNOWN, hash.type);
+    EXPECT_EQ(1u, hash.offset);
+
+    EXPECT_EQ(
+        PLT_TOKEN_EOF,
+        plt_next_token_slice(&lexer, source, source_length).type);
+}
+
+UTEST(lexing, identifies_fractional_numbers)
+{
+    const char* source = "3.14 2. .5";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+
+    plt_token_slice pi = plt_next_token_slice(&lexer, source, source_length);
+    EXPECT_EQ(PLT_TOKEN_NUMBER, pi.type);
+    EXPECT_EQ(4u, pi.length);
+
+    plt_token_slice two = plt_next_token_slice(&lexer, source, source_length);
+    EXPECT_EQ(PLT_TOKEN_NUMBER, two.type);
+    EXPECT_EQ(2u, two.length);
+
+    // Without a leading digit, a dot starts an identifier (think "...").
+    plt_token_slice half = plt_next_token_slice(&lexer, source, source_length);
+    EXPECT_EQ(PLT_TOKEN_IDENT, half.type);
+    EXPECT_EQ(2u, half.length);
+}
+
+UTEST(tokenizing, matches_token_by_token_lexing)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const char* source = "(define (square x) (* x x))\n'(1 2.5 three)";
+    const size_t source_length = strlen(source);
+
+    plt_token_stream stream = { 0 };
+    const unsigned int count = plt_tokenize(&context, source, source_length, &stream);
+
+    ASSERT_EQ(19u, count);
+    ASSERT_EQ(count, stream.count);
+
+    plt_lexer lexer = { 0 };
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        plt_token_slice slice = plt_next_token_slice(
+            &lexer,
+            source,
+            source_length);
+
+        EXPECT_EQ(slice.type, stream.types[i]);
+        EXPECT_EQ(slice.offset, stream.offsets[i]);
+        EXPECT_EQ(slice.length, stream.lengths[i]);
+    }
+
+    EXPECT_EQ(PLT_TOKEN_EOF, stream.types[count - 1]);
+
+    free(memory_pool);
+}
+
+UTEST(tokenizing, grows_for_dense_sources)
+{
+    const size_t memory_pool_size = 8192;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    // One token per byte, far more than the initial estimate.
+    char source[128];
+    memset(source, '(', sizeof(source));
+
+    plt_token_stream stream = { 0 };
+    const unsigned int count = plt_tokenize(&context, source, sizeof(source), &stream);
+
+    ASSERT_EQ(129u, count);
+    EXPECT_EQ(PLT_TOKEN_LIST_START, stream.types[127]);
+    EXPECT_EQ(127u, stream.offsets[127]);
+    EXPECT_EQ(PLT_TOKEN_EOF, stream.types[128]);
+
+    free(memory_pool);
+}
+
+UTEST(lexing, identifies_signed_numbers_and_booleans)
+{
+    const char* source = "(- -5 +7.5 -> +x #t #false #) -";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+
+    const char* expected[] = {
+        "(", "-", "-5", "+7.5", "->", "+x", "#t", "#false", "#", ")", "-"
+    };
+    const enum plt_token_type expected_types[] = {
+        PLT_TOKEN_LIST_START,
+        PLT_TOKEN_IDENT,
+        PLT_TOKEN_NUMBER,
+        PLT_TOKEN_NUMBER,
+        PLT_TOKEN_IDENT,
+        PLT_TOKEN_IDENT,
+        PLT_TOKEN_BOOLEAN,
+        PLT_TOKEN_BOOLEAN,
+        PLT_TOKEN_UNKNOWN,
+        PLT_TOKEN_LIST_END,
+        PLT_TOKEN_IDENT
+    };
+
+    for (int i = 0; i < 11; i++)
+    {
+        plt_token_slice slice = plt_next_token_slice(
+            &lexer,
+            source,
+            source_length);
+
+        EXPECT_EQ(expected_types[i], slice.type);
+        EXPECT_EQ(strlen(expected[i]), slice.length);
+        EXPECT_EQ(0, strncmp(expected[i], source + slice.offset, slice.length));
+    }
+
+    EXPECT_EQ(
+        PLT_TOKEN_EOF,
+        plt_next_token_slice(&lexer, source, source_length).type);
+}
+
+UTEST(lexing, chunked_lexing_matches_whole_source_lexing)
+{
+    const size_t memory_pool_size = 4096;
+    void* memory_pool = malloc(memory_pool_size);
+
+    const char* source = "(define  pi 3.14159)\n'(a-long-name ok) 42";
+    const int source_length = strlen(source);
+
+    const char* expected[] = {
+        "(", "define", "pi", "3.14159", ")", "'", "(", "a-long-name", "ok",
+        ")", "42"
+    };
+    const int expected_count = sizeof(expected) / sizeof(expected[0]);
+
+    // Split the source into chunks of every size, so that tokens get cut
+    // at every possible place.
+    for (int chunk_size = 1; chunk_size <= source_length; chunk_size++)
+    {
+        memset(memory_pool, 0, memory_pool_size);
+
+        plt_context context = { 0 };
+        plt_init(&context, memory_pool, memory_pool_size);
+
+        plt_lexer lexer = { 0 };
+        int found = 0;
+        int chunk_start = 0;
+
+        for (;;)
+        {
+            int chunk_length = source_length - chunk_start;
+            if (chunk_length > chunk_size)
+                chunk_length = chunk_size;
+
+            plt_token token = plt_next_token_chunk(
+                &context,
+                &lexer,
+                source + chunk_start,
+                chunk_length);
+
+            if (token.type == PLT_TOKEN_EOF)
+                break;
+            else if (token.type == PLT_TOKEN_INVALID)
+                chunk_start += chunk_length;
+            else
+            {
+                ASSERT_LT(found, expected_count);
+                EXPECT_STREQ(expected[found], token.text);
+                found++;
+            }
+        }
+
+        EXPECT_EQ(expected_count, found);
+    }
+
+    free(memory_pool);
+}
+
+// Creates a file of our own in the temp directory and opens it for writing,
+// so tests don't depend on (or leave anything in) the working directory.
+// Returns null if the file can't be made.
+static FILE*
+create_temporary_file(char* path, const size_t path_size)
+{
+#if defined(_WIN32)
+    char directory[MAX_PATH];
+
+    if (path_size < MAX_PATH
+        || !GetTempPathA(MAX_PATH, directory)
+        || !GetTempFileNameA(directory, "plt", 0, path))
+        return 0;
+
+    return fopen(path, "wb");
+#else
+    const char* directory = getenv("TMPDIR");
+
+    if (!directory || !*directory)
+        directory = "/tmp";
+
+    const int length =
+        snprintf(path, path_size, "%s/pilot_test_XXXXXX", directory);
+
+    if (length < 0 || (size_t)length >= path_size)
+        return 0;
+
+    const int descriptor = mkstemp(path);
+
+    return descriptor < 0 ? 0 : fdopen(descriptor, "wb");
+#endif
+}
+
+UTEST(tokenizing, lexes_mapped_files)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    char path[4096];
+    const char* source = "(display \"hi\")\n";
+
+    FILE* output = create_temporary_file(path, sizeof(path));
+    ASSERT_TRUE(output != 0);
+    fwrite(source, 1, strlen(source), output);
+    fclose(output);
+
+    plt_mapped_file file = { 0 };
+    plt_token_stream stream = { 0 };
+    const size_t count = plt_tokenize_file(&context, path, &file, &stream);
+
+    EXPECT_EQ(7u, count);
+    EXPECT_EQ(strlen(source), file.length);
+    EXPECT_EQ(PLT_TOKEN_IDENT, stream.types[1]);
+    EXPECT_EQ(0, strncmp("display", file.data + stream.offsets[1], 7));
+
+    plt_unmap_file(&file);
+    remove(path);
+
+    EXPECT_EQ(0u, plt_tokenize_file(&context, path, &file, &stream));
+
+    free(memory_pool);
+}
+
+UTEST(tokenizing, parallel_tokenizing_matches_serial_tokenizing)
+{
+    const size_t memory_pool_size = 64 * 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    // Mix short tokens with an identifier long enough to span several of the
+    // places the source gets split at.
+    char source[2048];
+    size_t source_length = 0;
+
+    for (int i = 0; source_length < 1024; i++)
+    {
+        source_length += sprintf(
+            source + source_length,
+            "(item-%d %d.%d '(x y))\n",
+            i,
+            i * 7,
+            i);
+    }
+
+    memset(source + source_length, 'z', 600);
+    source_length += 600;
+    source_length += sprintf(source + source_length, " 12 (end)");
+
+    plt_token_stream serial = { 0 };
+    const size_t serial_count = plt_tokenize(&context, source, source_length, &serial);
+
+    for (int threads = 2; threads <= 8; threads++)
+    {
+        plt_token_stream parallel = { 0 };
+        const size_t parallel_count = plt_tokenize_parallel(
+            &context,
+            source,
+            source_length,
+            threads,
+            &parallel);
+
+        ASSERT_EQ(serial_count, parallel_count);
+
+        for (size_t i = 0; i < serial_count; i++)
+        {
+            EXPECT_EQ(serial.types[i], parallel.types[i]);
+            EXPECT_EQ(serial.offsets[i], parallel.offsets[i]);
+            EXPECT_EQ(serial.lengths[i], parallel.lengths[i]);
+        }
+    }
+
+    free(memory_pool);
+}
+
+UTEST(symbols, interning_deduplicates_names)
+{
+    const size_t memory_pool_size = 256 * 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+
+    const size_t car = plt_intern(&context, &symbols, "car", 3);
+    const size_t cdr = plt_intern(&context, &symbols, "cdr", 3);
+
+    EXPECT_EQ(0u, car);
+    EXPECT_EQ(1u, cdr);
+
+    // Names don't have to be null terminated, or outlive the call.
+    EXPECT_EQ(car, plt_intern(&context, &symbols, "card", 3));
+    EXPECT_EQ(2u, plt_intern(&context, &symbols, "card", 4));
+    EXPECT_STREQ("car", plt_symbol_name(&symbols, car));
+    EXPECT_TRUE(plt_symbol_name(&symbols, 3) == 0);
+
+    // Enough names to grow the table a few times over.
+    char name[16];
+
+    for (int i = 0; i < 1000; i++)
+    {
+        const int length = snprintf(name, sizeof(name), "name-%d", i);
+        ASSERT_EQ(
+            3u + i,
+            plt_intern(&context, &symbols, name, (size_t)length));
+    }
+
+    for (int i = 0; i < 1000; i++)
+    {
+        const int length = snprintf(name, sizeof(name), "name-%d", i);
+        ASSERT_EQ(
+            3u + i,
+            plt_intern(&context, &symbols, name, (size_t)length));
+    }
+
+    EXPECT_EQ(1003u, symbols.count);
+    EXPECT_EQ(cdr, plt_intern(&context, &symbols, "cdr", 3));
+
+    free(memory_pool);
+}
+
+UTEST(symbols, lexers_intern_identifiers)
+{
+    const size_t memory_pool_size = 4096;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+
+    const char* source = "(define x (+ x 1))";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+    lexer.symbols = &symbols;
+
+    size_t ids[16];
+    size_t count = 0;
+
+    plt_token t;
+    do {
+        t = plt_next_token(&context, &lexer, source, source_length);
+
+        if (t.type == PLT_TOKEN_IDENT)
+            ids[count++] = t.symbol;
+        else
+            EXPECT_EQ(PLT_NO_SYMBOL, t.symbol);
+    } while (t.type != PLT_TOKEN_EOF);
+
+    ASSERT_EQ(4u, count);
+    EXPECT_EQ(0u, ids[0]);
+    EXPECT_EQ(1u, ids[1]);
+    EXPECT_EQ(2u, ids[2]);
+    EXPECT_EQ(ids[1], ids[3]);
+    EXPECT_STREQ("define", plt_symbol_name(&symbols, ids[0]));
+
+    // Identifiers split across chunks come out as the same symbols.
+    plt_lexer chunked_lexer = { 0 };
+    chunked_lexer.symbols = &symbols;
+
+    const char* chunks[] = { "(def", "ine x", "", 0 };
+    count = 0;
+
+    for (int i = 0; chunks[i]; i++)
+    {
+        const size_t chunk_length = strlen(chunks[i]);
+
+        for (;;)
+        {
+            t = plt_next_token_chunk(
+                &context,
+                &chunked_lexer,
+                chunks[i],
+                chunk_length);
+
+            if (t.type == PLT_TOKEN_IDENT)
+                ids[count++] = t.symbol;
+
+            if (t.type == PLT_TOKEN_INVALID || t.type == PLT_TOKEN_EOF)
+                break;
+        }
+    }
+
+    ASSERT_EQ(2u, count);
+    EXPECT_EQ(0u, ids[0]);
+    EXPECT_EQ(1u, ids[1]);
+    EXPECT_EQ(3u, symbols.count);
+
+    free(memory_pool);
+}
+
+UTEST(numbers, decodes_fixnums_and_flonums)
+{
+    plt_number number = plt_decode_number("12345", 5);
+    EXPECT_FALSE(number.is_flonum);
+    EXPECT_EQ(12345u, number.fixnum);
+
+    // Too big for a fixnum.
+    const char* huge = "1000000000000000000000000000000";
+    number = plt_decode_number(huge, strlen(huge));
+    EXPECT_TRUE(number.is_flonum);
+    EXPECT_TRUE(number.flonum == 1e30);
+
+    number = plt_decode_number("0.1", 3);
+    EXPECT_TRUE(number.is_flonum);
+    EXPECT_TRUE(number.flonum == 0.1);
+
+    // Fixnums keep their sign apart from their magnitude.
+    number = plt_decode_number("-12345", 6);
+    EXPECT_FALSE(number.is_flonum);
+    EXPECT_TRUE(number.is_negative);
+    EXPECT_EQ(12345u, number.fixnum);
+
+    number = plt_decode_number("+0.1", 4);
+    EXPECT_FALSE(number.is_negative);
+    EXPECT_TRUE(number.flonum == 0.1);
+
+    number = plt_decode_number("-0.1", 4);
+    EXPECT_TRUE(number.flonum == -0.1);
+
+    number = plt_decode_number("-9007199254740993.0", 19);
+    EXPECT_TRUE(number.flonum == -9007199254740992.0);
+
+    number = plt_decode_number("2.", 2);
+    EXPECT_TRUE(number.is_flonum);
+    EXPECT_TRUE(number.flonum == 2.0);
+
+    // Halfway between two doubles, so it rounds to the even one.
+    number = plt_decode_number("9007199254740993.0", 18);
+    EXPECT_TRUE(number.flonum == 9007199254740992.0);
+
+    // Just past halfway, which takes every digit to tell.
+    const char* past_halfway = "9007199254740993.00000000000000000000000001";
+    number = plt_decode_number(past_halfway, strlen(past_halfway));
+    EXPECT_TRUE(number.flonum == 9007199254740994.0);
+
+    // The smallest subnormal double, written out in full.
+    char subnormal[400] = "0.";
+    for (int i = 0; i < 323; i++)
+        strcat(subnormal, "0");
+    strcat(subnormal, "49406564584124654");
+
+    number = plt_decode_number(subnormal, strlen(subnormal));
+    EXPECT_TRUE(number.flonum == 4.9406564584124654e-324);
+}
+
+UTEST(numbers, lexers_decode_numbers)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const char* source = "(+ 42 3.25)";
+    const size_t source_length = strlen(source);
+
+    plt_lexer lexer = { 0 };
+    plt_token t;
+
+    for (int i = 0; i < 3; i++)
+        t = plt_next_token(&context, &lexer, source, source_length);
+
+    ASSERT_EQ(PLT_TOKEN_NUMBER, t.type);
+    EXPECT_FALSE(t.number.is_flonum);
+    EXPECT_EQ(42u, t.number.fixnum);
+
+    t = plt_next_token(&context, &lexer, source, source_length);
+
+    ASSERT_EQ(PLT_TOKEN_NUMBER, t.type);
+    EXPECT_TRUE(t.number.is_flonum);
+    EXPECT_TRUE(t.number.flonum == 3.25);
+
+    // Numbers split across chunks are decoded whole.
+    plt_lexer chunked_lexer = { 0 };
+
+    t = plt_next_token_chunk(&context, &chunked_lexer, "12", 2);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
+
+    t = plt_next_token_chunk(&context, &chunked_lexer, "34 ", 3);
+    ASSERT_EQ(PLT_TOKEN_NUMBER, t.type);
+    EXPECT_EQ(1234u, t.number.fixnum);
+
+    // Finish off the chunk, then split a flonum across the next ones. Its
+    // digits are gathered as they arrive, even across the decimal point.
+    t = plt_next_token_chunk(&context, &chunked_lexer, "34 ", 3);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
+
+    t = plt_next_token_chunk(&context, &chunked_lexer, "5.", 2);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
+
+    t = plt_next_token_chunk(&context, &chunked_lexer, "125", 3);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
+
+    t = plt_next_token_chunk(&context, &chunked_lexer, "", 0);
+    ASSERT_EQ(PLT_TOKEN_NUMBER, t.type);
+    EXPECT_TRUE(t.number.is_flonum);
+    EXPECT_TRUE(t.number.flonum == 5.125);
+
+    // A sign in one chunk still belongs to the digits in the next.
+    t = plt_next_token_chunk(&context, &chunked_lexer, "-", 1);
+    EXPECT_EQ(PLT_TOKEN_INVALID, t.type);
+
+    t = plt_next_token_chunk(&context, &chunked_lexer, "8 ", 2);
+    ASSERT_EQ(PLT_TOKEN_NUMBER, t.type);
+    EXPECT_TRUE(t.number.is_negative);
+    EXPECT_EQ(8u, t.number.fixnum);
+
+    free(memory_pool);
+}
+
+UTEST(values, immediates_never_allocate)
+{
+    const size_t memory_pool_size = 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    const long long fixnums[] = { 0, 1, -1, PLT_FIXNUM_MAX, PLT_FIXNUM_MIN };
+
+    for (int i = 0; i < 5; i++)
+    {
+        const plt_value fixnum = plt_make_fixnum(fixnums[i]);
+        EXPECT_EQ(PLT_VALUE_FIXNUM, plt_type_of(fixnum));
+        EXPECT_EQ(fixnums[i], plt_fixnum_value(fixnum));
+    }
+
+    const plt_value character = plt_make_character(0x1F6EB);
+    EXPECT_EQ(PLT_VALUE_CHARACTER, plt_type_of(character));
+    EXPECT_EQ(0x1F6EBu, plt_character_value(character));
+
+    EXPECT_EQ(PLT_VALUE_BOOLEAN, plt_type_of(plt_make_boolean(1)));
+    EXPECT_EQ(PLT_TRUE, plt_make_boolean(1));
+    EXPECT_EQ(PLT_FALSE, plt_make_boolean(0));
+    EXPECT_EQ(PLT_VALUE_EMPTY_LIST, plt_type_of(PLT_EMPTY_LIST));
+    EXPECT_EQ(PLT_VALUE_UNSPECIFIED, plt_type_of(PLT_UNSPECIFIED));
+
+    const plt_value symbol = plt_make_symbol(42);
+    EXPECT_EQ(PLT_VALUE_SYMBOL, plt_type_of(symbol));
+    EXPECT_EQ(42u, plt_symbol_value(symbol));
+
+    EXPECT_EQ(0u, plt_get_arena_stats(&context).allocation_count);
+
+    // Pairs and flonums do live in the arena.
+    const plt_value flonum = plt_make_flonum(&context, 0.5);
+    const plt_value pair = plt_cons(&context, flonum, PLT_EMPTY_LIST);
+
+    EXPECT_EQ(PLT_VALUE_FLONUM, plt_type_of(flonum));
+    EXPECT_TRUE(plt_flonum_value(flonum) == 0.5);
+    EXPECT_EQ(PLT_VALUE_PAIR, plt_type_of(pair));
+    EXPECT_EQ(flonum, plt_car(pair));
+    EXPECT_EQ(PLT_EMPTY_LIST, plt_cdr(pair));
+    EXPECT_EQ(2u, plt_get_arena_stats(&context).allocation_count);
+
+    free(memory_pool);
+}
+
+UTEST(reading, reads_nested_lists)
+{
+    const size_t memory_pool_size = 8192;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    const char* source = "(define (f x) '(1 . 2.5)) ()";
+    const size_t source_length = strlen(source);
+
+    plt_read_result result =
+        plt_read(&context, &reader, source, source_length);
+
+    ASSERT_EQ(PLT_READ_OK, result.status);
+    EXPECT_EQ(0u, result.offset);
+    EXPECT_TRUE(result.allocated_length > 0);
+
+    // (define ...)
+    const plt_value form = result.form;
+    ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(form));
+    ASSERT_EQ(PLT_VALUE_SYMBOL, plt_type_of(plt_car(form)));
+    EXPECT_STREQ(
+        "define",
+        plt_symbol_name(&symbols, plt_symbol_value(plt_car(form))));
+
+    // (f x)
+    const plt_value signature = plt_car(plt_cdr(form));
+    ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(signature));
+    EXPECT_STREQ(
+        "x",
+        plt_symbol_name(
+            &symbols,
+            plt_symbol_value(plt_car(plt_cdr(signature)))));
+    EXPECT_EQ(PLT_EMPTY_LIST, plt_cdr(plt_cdr(signature)));
+
+    // (quote (1 . 2.5))
+    const plt_value quote = plt_car(plt_cdr(plt_cdr(form)));
+    ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(quote));
+    EXPECT_STREQ(
+        "quote",
+        plt_symbol_name(&symbols, plt_symbol_value(plt_car(quote))));
+
+    const plt_value dotted = plt_car(plt_cdr(quote));
+    ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(dotted));
+    ASSERT_EQ(PLT_VALUE_FIXNUM, plt_type_of(plt_car(dotted)));
+    EXPECT_EQ(1, plt_fixnum_value(plt_car(dotted)));
+    ASSERT_EQ(PLT_VALUE_FLONUM, plt_type_of(plt_cdr(dotted)));
+    EXPECT_TRUE(plt_flonum_value(plt_cdr(dotted)) == 2.5);
+    EXPECT_EQ(PLT_EMPTY_LIST, plt_cdr(plt_cdr(plt_cdr(form))));
+
+    // The empty list doesn't take up any memory.
+    result = plt_read(&context, &reader, source, source_length);
+    EXPECT_EQ(PLT_READ_OK, result.status);
+    EXPECT_EQ(PLT_EMPTY_LIST, result.form);
+    EXPECT_EQ(0u, result.allocated_length);
+
+    result = plt_read(&context, &reader, source, source_length);
+    EXPECT_EQ(PLT_READ_EOF, result.status);
+
+    free(memory_pool);
+}
+
+UTEST(reading, reads_booleans_and_signed_numbers)
+{
+    const size_t memory_pool_size = 8192;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    // The smallest fixnum, and the number just past the biggest.
+    const char* source =
+        "(#t #f #true #false -5 +7 -2.5 - -x "
+        "-4611686018427387904 4611686018427387904)";
+
+    const plt_read_result result =
+        plt_read(&context, &reader, source, strlen(source));
+
+    ASSERT_EQ(PLT_READ_OK, result.status);
+
+    plt_value list = result.form;
+    plt_value items[11];
+
+    for (int i = 0; i < 11; i++)
+    {
+        ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(list));
+        items[i] = plt_car(list);
+        list = plt_cdr(list);
+    }
+
+    EXPECT_EQ(PLT_EMPTY_LIST, list);
+
+    EXPECT_EQ(PLT_TRUE, items[0]);
+    EXPECT_EQ(PLT_FALSE, items[1]);
+    EXPECT_EQ(PLT_TRUE, items[2]);
+    EXPECT_EQ(PLT_FALSE, items[3]);
+
+    ASSERT_EQ(PLT_VALUE_FIXNUM, plt_type_of(items[4]));
+    EXPECT_EQ(-5, plt_fixnum_value(items[4]));
+    ASSERT_EQ(PLT_VALUE_FIXNUM, plt_type_of(items[5]));
+    EXPECT_EQ(7, plt_fixnum_value(items[5]));
+    ASSERT_EQ(PLT_VALUE_FLONUM, plt_type_of(items[6]));
+    EXPECT_TRUE(plt_flonum_value(items[6]) == -2.5);
+
+    ASSERT_EQ(PLT_VALUE_SYMBOL, plt_type_of(items[7]));
+    EXPECT_STREQ("-", plt_symbol_name(&symbols, plt_symbol_value(items[7])));
+    ASSERT_EQ(PLT_VALUE_SYMBOL, plt_type_of(items[8]));
+    EXPECT_STREQ("-x", plt_symbol_name(&symbols, plt_symbol_value(items[8])));
+
+    ASSERT_EQ(PLT_VALUE_FIXNUM, plt_type_of(items[9]));
+    EXPECT_EQ(PLT_FIXNUM_MIN, plt_fixnum_value(items[9]));
+    ASSERT_EQ(PLT_VALUE_FLONUM, plt_type_of(items[10]));
+    EXPECT_TRUE(plt_flonum_value(items[10]) == 4611686018427387904.0);
+
+    free(memory_pool);
+}
+
+UTEST(reading, reports_malformed_forms)
+{
+    const size_t memory_pool_size = 4096;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+
+    const char* sources[] = {
+        ")", "(a . )", "(. a)", "(a . b c)", "(a", "#", "#tru"
+    };
+    const enum plt_read_status statuses[] = {
+        PLT_READ_UNEXPECTED_LIST_END,
+        PLT_READ_MISPLACED_DOT,
+        PLT_READ_MISPLACED_DOT,
+        PLT_READ_MISPLACED_DOT,
+        PLT_READ_UNTERMINATED_LIST,
+        PLT_READ_UNKNOWN_TOKEN,
+        PLT_READ_UNKNOWN_TOKEN,
+    };
+
+    for (int i = 0; i < 7; i++)
+    {
+        plt_reader reader = { 0 };
+        reader.symbols = &symbols;
+
+        const plt_read_result result =
+            plt_read(&context, &reader, sources[i], strlen(sources[i]));
+
+        EXPECT_STREQ(
+            plt_read_status_to_string(statuses[i]),
+            plt_read_status_to_string(result.status));
+    }
+
+    free(memory_pool);
+}
+
+UTEST(reading, reads_deep_nesting_without_recursing)
+{
+    const size_t depth = 100000;
+    const size_t memory_pool_size = 8 * 1024 * 1024;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    char* source = malloc(2 * depth);
+    memset(source, '(', depth);
+    memset(source + depth, ')', depth);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    const plt_read_result result =
+        plt_read(&context, &reader, source, 2 * depth);
+
+    ASSERT_EQ(PLT_READ_OK, result.status);
+
+    // Each list holds the next one down, and the innermost is empty.
+    size_t nesting = 0;
+    plt_value list = result.form;
+
+    for (; list != PLT_EMPTY_LIST; list = plt_car(list))
+    {
+        ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(list));
+        ASSERT_EQ(PLT_EMPTY_LIST, plt_cdr(list));
+        nesting++;
+    }
+
+    EXPECT_EQ(depth - 1, nesting);
+
+    free(source);
+    free(memory_pool);
+}
+
+/**
+ * Reads and evaluates every form in the source, and returns the last result.
+ */
+static plt_eval_result
+evaluate_source(plt_vm* vm, plt_reader* reader, const char* source)
+{
+    plt_eval_result result = { PLT_EVAL_OK, PLT_UNSPECIFIED };
+    plt_read_result read;
+
+    while ((read = plt_read(
+        vm->context,
+        reader,
+        source,
+        strlen(source))).status == PLT_READ_OK)
+    {
+        result = plt_eval(vm, read.form);
+
+        if (result.status != PLT_EVAL_OK)
+            break;
+    }
+
+    return result;
+}
+
+UTEST(evaluation, evaluates_recursive_procedures)
+{
+    const size_t memory_pool_size = 1 << 20;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 1024));
+
+    plt_eval_result result = evaluate_source(
+        &vm,
+        &reader,
+        "(define (factorial n) (if (< n 2) 1 (* n (factorial (- n 1)))))"
+        "(factorial 10)");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    ASSERT_EQ(PLT_VALUE_FIXNUM, plt_type_of(result.value));
+    EXPECT_EQ(3628800, plt_fixnum_value(result.value));
+
+    // Overflowing fixnums carry on as flonums.
+    reader = (plt_reader){ 0 };
+    reader.symbols = &symbols;
+    result = evaluate_source(&vm, &reader, "(factorial 25)");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    ASSERT_EQ(PLT_VALUE_FLONUM, plt_type_of(result.value));
+    EXPECT_TRUE(plt_flonum_value(result.value) > 1.5511210043e25);
+    EXPECT_TRUE(plt_flonum_value(result.value) < 1.5511210044e25);
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, evaluates_booleans_and_signed_numbers)
+{
+    const size_t memory_pool_size = 1 << 20;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 1024));
+
+    struct {
+        const char* source;
+        plt_value value;
+    } cases[] = {
+        { "(if #f 1 2)", plt_make_fixnum(2) },
+        { "(if #t 1 2)", plt_make_fixnum(1) },
+        { "(if #f 1)", PLT_UNSPECIFIED },
+        { "(not #f)", PLT_TRUE },
+        { "(- -5 1)", plt_make_fixnum(-6) },
+        { "(+ +7 -7)", plt_make_fixnum(0) },
+        { "(< -2 -1)", PLT_TRUE },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+    {
+        plt_reader reader = { 0 };
+        reader.symbols = &symbols;
+
+        const plt_eval_result result =
+            evaluate_source(&vm, &reader, cases[i].source);
+
+        EXPECT_EQ(PLT_EVAL_OK, result.status);
+        EXPECT_EQ(cases[i].value, result.value);
+    }
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, closes_over_variables)
+{
+    const size_t memory_pool_size = 1 << 20;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 1024));
+
+    plt_eval_result result = evaluate_source(
+        &vm,
+        &reader,
+        "(define (make-counter)"
+        "  (let ((count 0))"
+        "    (lambda () (set! count (+ count 1)) count)))"
+        "(define a (make-counter))"
+        "(define b (make-counter))"
+        "(a) (a) (b)"
+        "(define (make-adder x) (lambda (y) (+ x y)))"
+        "(begin"
+        "  (define total ((make-adder (a)) 10))"
+        "  (if (eq? (car '(x y)) 'x) (cons total (b)) '()))");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(result.value));
+    EXPECT_EQ(13, plt_fixnum_value(plt_car(result.value)));
+    EXPECT_EQ(2, plt_fixnum_value(plt_cdr(result.value)));
+
+    // A later let doesn't overwrite a variable that a closure still reads.
+    reader = (plt_reader){ 0 };
+    reader.symbols = &symbols;
+    result = evaluate_source(
+        &vm,
+        &reader,
+        "(let ((f (let ((x 1)) (lambda () x))))"
+        "  (let ((y 2)) (+ (f) (* y 10))))");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    EXPECT_EQ(21, plt_fixnum_value(result.value));
+
+    reader = (plt_reader){ 0 };
+    reader.symbols = &symbols;
+    result = evaluate_source(
+        &vm,
+        &reader,
+        "(let ((a (let ((x 1)) (lambda () x)))) (a))");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    EXPECT_EQ(1, plt_fixnum_value(result.value));
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, resolves_variables_lexically)
+{
+    const size_t memory_pool_size = 1 << 20;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 1024));
+
+    // Parameters shadow globals and outer parameters, and procedures can
+    // refer to globals defined after them.
+    plt_eval_result result = evaluate_source(
+        &vm,
+        &reader,
+        "(define x 1)"
+        "(define (f x) (let ((y (* x 10))) (lambda (x) (+ x y z))))"
+        "(define z 100)"
+        "((f 2) 3)");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    EXPECT_EQ(123, plt_fixnum_value(result.value));
+
+    // Variables compile to their addresses, rather than their names.
+    reader = (plt_reader){ 0 };
+    reader.symbols = &symbols;
+
+    const plt_read_result form = plt_read(
+        &context,
+        &reader,
+        "(lambda (a b) (lambda () (set! b a)))",
+        strlen("(lambda (a b) (lambda () (set! b a)))"));
+    ASSERT_EQ(PLT_READ_OK, form.status);
+
+    plt_prototype* prototype = 0;
+    ASSERT_EQ(PLT_EVAL_OK, plt_compile(&vm, form.form, &prototype).status);
+
+    // The outer lambda captures nothing, so its closure is made just once.
+    ASSERT_EQ(1u, prototype->constant_count);
+    ASSERT_EQ(PLT_VALUE_PROCEDURE, plt_type_of(prototype->constants[0]));
+
+    const plt_prototype* outer =
+        ((const plt_procedure_box*)prototype->constants[0])->prototype;
+    const plt_prototype* inner = outer->children[0];
+
+    // The inner closure copies a, and shares b in a box, since it assigns b.
+    const unsigned int expected_outer[] = {
+        PLT_OP_BOX, 1,
+        PLT_OP_CLOSURE, 0,
+        PLT_OP_RETURN,
+    };
+    const unsigned int expected_captures[] = {
+        PLT_CAPTURE_LOCAL, 0,
+        PLT_CAPTURE_LOCAL, 1,
+    };
+    const unsigned int expected_inner[] = {
+        PLT_OP_FREE, 0,
+        PLT_OP_SET_FREE_CELL, 1,
+        PLT_OP_RETURN,
+    };
+
+    ASSERT_EQ(5u, outer->code_length);
+    ASSERT_EQ(2u, inner->capture_count);
+    ASSERT_EQ(5u, inner->code_length);
+
+    for (size_t i = 0; i < 5; i++)
+    {
+        EXPECT_EQ(expected_outer[i], outer->code[i]);
+        EXPECT_EQ(expected_inner[i], inner->code[i]);
+    }
+
+    for (size_t i = 0; i < 4; i++)
+        EXPECT_EQ(expected_captures[i], inner->captures[i]);
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, builds_flat_closures)
+{
+    const size_t memory_pool_size = 1 << 20;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 1024));
+
+    // Closures that assign a variable share it with every other closure over
+    // it, while the rest get copies.
+    plt_eval_result result = evaluate_source(
+        &vm,
+        &reader,
+        "(define (make-account balance fee)"
+        "  (cons (lambda (amount) (set! balance (- balance amount fee)))"
+        "        (lambda () balance)))"
+        "(define account (make-account 100 1))"
+        "((car account) 10)"
+        "((car account) 20)"
+        "(let loop ((i 0) (thunk (lambda () 'none)))"
+        "  (if (= i 3)"
+        "      (cons ((cdr account)) (thunk))"
+        "      (loop (+ i 1) (lambda () (if (< i 0) (loop 0 0) i)))))");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(result.value));
+    EXPECT_EQ(68, plt_fixnum_value(plt_car(result.value)));
+    EXPECT_EQ(2, plt_fixnum_value(plt_cdr(result.value)));
+
+    // A closure over up to three values fits in a cache line.
+    EXPECT_TRUE(sizeof(plt_procedure_box) + 3 * sizeof(plt_value) <= 64);
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, frees_regions_on_return)
+{
+    // Without regions, the lists built below would need megabytes.
+    const size_t memory_pool_size = 1 << 16;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 1024));
+
+    plt_eval_result result = evaluate_source(
+        &vm,
+        &reader,
+        "(define (build n) (if (= n 0) '() (cons n (build (- n 1)))))"
+        "(define (sum l) (if (null? l) 0 (+ (car l) (sum (cdr l)))))"
+        "(define (total n) (sum (build n)))"
+        "(define (repeat i)"
+        "  (if (= i 0) 0 (begin (total 100) (repeat (- i 1)))))"
+        "(define keep '())"
+        "(define (stash n) (set! keep (build n)))");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+
+    // Only procedures whose results cannot hold what they allocate get
+    // regions of their own.
+    const char* procedures[] = {
+        "(lambda (n) (sum (build n)))",
+        "(lambda (n) (cons n (build n)))",
+        "(lambda (n) (set! keep (build n)))",
+    };
+    const size_t expected_regions[] = {
+        PLT_REGION_LOCAL,
+        PLT_REGION_CALLER,
+        PLT_REGION_CALLER,
+    };
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        reader = (plt_reader){ 0 };
+        reader.symbols = &symbols;
+
+        const plt_read_result form = plt_read(
+            &context,
+            &reader,
+            procedures[i],
+            strlen(procedures[i]));
+        ASSERT_EQ(PLT_READ_OK, form.status);
+
+        plt_prototype* prototype = 0;
+        ASSERT_EQ(
+            PLT_EVAL_OK,
+            plt_compile(&vm, form.form, &prototype).status);
+        ASSERT_EQ(PLT_VALUE_PROCEDURE, plt_type_of(prototype->constants[0]));
+
+        const plt_prototype* procedure =
+            ((const plt_procedure_box*)prototype->constants[0])->prototype;
+        EXPECT_EQ(expected_regions[i], procedure->region);
+    }
+
+    // Every call to total frees its list on return.
+    const char* source = "(repeat 1000)";
+    reader = (plt_reader){ 0 };
+    reader.symbols = &symbols;
+
+    const plt_read_result form =
+        plt_read(&context, &reader, source, strlen(source));
+    ASSERT_EQ(PLT_READ_OK, form.status);
+
+    plt_prototype* prototype = 0;
+    ASSERT_EQ(PLT_EVAL_OK, plt_compile(&vm, form.form, &prototype).status);
+
+    result = plt_execute(&vm, prototype);
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+
+    const size_t used_length = plt_get_arena_stats(&context).used_length;
+    result = plt_execute(&vm, prototype);
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    EXPECT_EQ(used_length, plt_get_arena_stats(&context).used_length);
+
+    // Lists that escape through a global or the result are kept.
+    reader = (plt_reader){ 0 };
+    reader.symbols = &symbols;
+    result = evaluate_source(
+        &vm,
+        &reader,
+        "(stash 5)"
+        "(total 100)"
+        "(let ((fresh (build 10))) (cons (sum keep) (sum fresh)))");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    ASSERT_EQ(PLT_VALUE_PAIR, plt_type_of(result.value));
+    EXPECT_EQ(15, plt_fixnum_value(plt_car(result.value)));
+    EXPECT_EQ(55, plt_fixnum_value(plt_cdr(result.value)));
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, frees_regions_in_loops)
+{
+    // Too small for what the loops below allocate, all told.
+    const size_t memory_pool_size = 1 << 16;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 1024));
+
+    plt_eval_result result = evaluate_source(
+        &vm,
+        &reader,
+        "(define (gather n)"
+        "  (let loop ((i n) (items '()))"
+        "    (if (= i 0) (car items) (loop (- i 1) (cons i items)))))"
+        "(define (gather-all) (gather 1000))");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+
+    // Each time around, a loop frees what it allocated last time, unless it
+    // passes it on. What it does pass on is freed once it returns, and top
+    // level forms free their regions too.
+    const char* sources[] = {
+        "(let loop ((i 10000))"
+        "  (if (= i 0) 'done (begin (cons i i) (loop (- i 1)))))",
+        "(gather-all)",
+    };
+
+    for (int i = 0; i < 2; i++)
+    {
+        reader = (plt_reader){ 0 };
+        reader.symbols = &symbols;
+
+        const plt_read_result form =
+            plt_read(&context, &reader, sources[i], strlen(sources[i]));
+        ASSERT_EQ(PLT_READ_OK, form.status);
+
+        plt_prototype* prototype = 0;
+        ASSERT_EQ(
+            PLT_EVAL_OK,
+            plt_compile(&vm, form.form, &prototype).status);
+
+        const size_t used_length = plt_get_arena_stats(&context).used_length;
+
+        for (int j = 0; j < 10; j++)
+        {
+            result = plt_execute(&vm, prototype);
+            ASSERT_EQ(PLT_EVAL_OK, result.status);
+            EXPECT_EQ(
+                used_length,
+                plt_get_arena_stats(&context).used_length);
+        }
+    }
+
+    EXPECT_EQ(1, plt_fixnum_value(result.value));
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, runs_tail_calls_in_constant_space)
+{
+    // The virtual machine itself takes a few KiB, which leaves too little
+    // room for a million calls unless tail calls reuse their space.
+    const size_t memory_pool_size = 16384;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+    plt_reader reader = { 0 };
+    reader.symbols = &symbols;
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 32));
+
+    plt_eval_result result = evaluate_source(
+        &vm,
+        &reader,
+        "(define (count n total)"
+        "  (let ((next (- n 1)))"
+        "    (if (< next 0) total (count next (+ total 2)))))"
+        "(define (is-even n) (if (= n 0) 'even (is-odd (- n 1))))"
+        "(define (is-odd n) (if (= n 0) 'odd (is-even (- n 1))))"
+        "(is-even 100001)");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    EXPECT_STREQ(
+        "odd",
+        plt_symbol_name(&symbols, plt_symbol_value(result.value)));
+
+    reader = (plt_reader){ 0 };
+    reader.symbols = &symbols;
+    result = evaluate_source(
+        &vm,
+        &reader,
+        "(let loop ((i 100000) (total 0))"
+        "  (if (= i 0) total (loop (- i 1) (+ total i))))");
+
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    EXPECT_EQ(5000050000, plt_fixnum_value(result.value));
+
+    const char* source = "(count 1000000 0)";
+    reader = (plt_reader){ 0 };
+    reader.symbols = &symbols;
+
+    const plt_read_result form =
+        plt_read(&context, &reader, source, strlen(source));
+    ASSERT_EQ(PLT_READ_OK, form.status);
+
+    plt_prototype* prototype = 0;
+    ASSERT_EQ(PLT_EVAL_OK, plt_compile(&vm, form.form, &prototype).status);
+
+    result = plt_execute(&vm, prototype);
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    EXPECT_EQ(2000000, plt_fixnum_value(result.value));
+
+    // Running it again allocates nothing new: every call reuses the same space.
+    const size_t used_length = plt_get_arena_stats(&context).used_length;
+    result = plt_execute(&vm, prototype);
+    ASSERT_EQ(PLT_EVAL_OK, result.status);
+    EXPECT_EQ(used_length, plt_get_arena_stats(&context).used_length);
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, reports_errors)
+{
+    const size_t memory_pool_size = 1 << 20;
+    void* memory_pool = malloc(memory_pool_size);
+    memset(memory_pool, 0, memory_pool_size);
+
+    plt_context context = { 0 };
+    plt_init(&context, memory_pool, memory_pool_size);
+
+    plt_symbol_table symbols = { 0 };
+
+    plt_vm vm = { 0 };
+    ASSERT_TRUE(plt_init_vm(&vm, &context, &symbols, 64));
+
+    struct {
+        const char* source;
+        enum plt_eval_status status;
+    } cases[] = {
+        { "(undefined 1)", PLT_EVAL_UNBOUND_VARIABLE },
+        { "(1 2)", PLT_EVAL_NOT_A_PROCEDURE },
+        { "((lambda (x) x))", PLT_EVAL_WRONG_ARGUMENT_COUNT },
+        { "(car 1)", PLT_EVAL_WRONG_TYPE },
+        { "(quotient 1 0)", PLT_EVAL_DIVIDE_BY_ZERO },
+        { "(if)", PLT_EVAL_SYNTAX_ERROR },
+        { "(lambda (x) (define y x))", PLT_EVAL_SYNTAX_ERROR },
+        { "(define (loop n) (+ 1 (loop n))) (loop 0)", PLT_EVAL_STACK_OVERFLOW },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+    {
+        plt_reader reader = { 0 };
+        reader.symbols = &symbols;
+
+        const plt_eval_result result =
+            evaluate_source(&vm, &reader, cases[i].source);
+
+        EXPECT_STREQ(
+            plt_eval_status_to_string(cases[i].status),
+            plt_eval_status_to_string(result.status));
+    }
+
+    free(memory_pool);
+}
+
+UTEST(evaluation, runs_out_of_memory_cleanly)
+{
+    // Each lambda captures from the ones around it, so running out of memory
+    // can happen while compiling any of them.
+    const char* source =
+        "((((lambda (a) (lambda (b) (lambda (c) (+ a b c)))) 1) 2) 3)";
+
+    is_running_out_of_memory = 1;
+
+    // From too small to read the form, up to plenty for evaluating it.
+    for (size_t size = 4096; size <= 12288; size += 8)
+    {
+        void* memory_pool = malloc(size);
+        memset(memory_pool, 0, size);
+
+        plt_context context = { 0 };
+        plt_init(&context, memory_pool, size);
+
+        plt_symbol_table symbols = { 0 };
+        plt_reader reader = { 0 };
+        reader.symbols = &symbols;
+
+        plt_vm vm = { 0 };
+        plt_eval_result result = { PLT_EVAL_OUT_OF_MEMORY, PLT_UNSPECIFIED };
+
+        const plt_read_result form = plt_init_vm(&vm, &context, &symbols, 16)
+            ? plt_read(&context, &reader, source, strlen(source))
+            : (plt_read_result){ .status = PLT_READ_OUT_OF_MEMORY };
+
+        plt_prototype* prototype = 0;
+
+        if (form.status == PLT_READ_OK)
+            result = plt_compile(&vm, form.form, &prototype);
+
+        if (result.status == PLT_EVAL_OK)
+        {
+            ASSERT_TRUE(prototype->code_length > 0);
+            result = plt_execute(&vm, prototype);
+        }
+
+        if (result.status == PLT_EVAL_OK || size == 12288)
+        {
+            ASSERT_EQ(PLT_EVAL_OK, result.status);
+            EXPECT_EQ(6, plt_fixnum_value(result.value));
+        }
+        else
+        {
+            EXPECT_EQ(PLT_EVAL_OUT_OF_MEMORY, result.status);
+        }
+
+        free(memory_pool);
+    }
+
+    is_running_out_of_memory = 0;
+}
+
 UTEST_MAIN()